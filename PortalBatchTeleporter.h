@@ -0,0 +1,346 @@
+/**
+ * PortalBatchTeleporter.h - 大批量实体的门户穿越/传送
+ *
+ * PortalTeleporter::ShouldTeleport / TeleportEntity 一次只处理一个 AoS 实体。
+ * 对成千上万的投射物、碎片，这里提供 SoA（结构数组）布局的批量接口：
+ * 穿越检测、边界检测和传送在同一个 SIMD 内核中完成（AVX2 / SSE2，
+ * 其余平台回退到标量实现），最后返回紧凑的已传送实体索引列表。
+ *
+ * 语义与逐实体循环一致：
+ *   for each entity: for each portal: if (ShouldTeleport) { TeleportEntity; break; }
+ * 唯一区别是速度直接乘以门户变换的旋转部分（门户变换为刚体变换，
+ * 与 TeleportDirection × length 等价）。
+ */
+
+#pragma once
+
+#include "PortalMath.h"
+#include "PortalRenderer.h"
+#include "PortalTeleporter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if !defined(PORTAL_BATCH_FORCE_SCALAR)
+    #if defined(__AVX2__)
+        #define PORTAL_BATCH_AVX2 1
+        #include <immintrin.h>
+    #endif
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define PORTAL_BATCH_SSE2 1
+        #include <emmintrin.h>
+    #endif
+#endif
+
+namespace PortalTeleporter {
+
+/**
+ * SoA 实体集合：每个分量一个连续数组
+ */
+struct EntityBatch {
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> prevX, prevY, prevZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> lastTeleportTime;
+
+    size_t Size() const { return posX.size(); }
+
+    void Resize(size_t count) {
+        for (std::vector<float>* column : { &posX, &posY, &posZ, &prevX, &prevY, &prevZ, &velX, &velY, &velZ }) {
+            column->resize(count, 0.0f);
+        }
+        lastTeleportTime.resize(count, 0.0f);
+    }
+};
+
+/**
+ * 批量内核使用的门户数据（由 PortalLink 展开为标量，便于广播到 SIMD 寄存器）
+ */
+struct BatchPortal {
+    float plane[4];         // 入口门户世界平面
+    float localX[4];        // sourceInverse 第0行：世界 -> 门户局部 X
+    float localY[4];        // sourceInverse 第1行：世界 -> 门户局部 Y
+    float halfWidth;
+    float halfHeight;
+    float forward[3][4];    // link.forward 的前三行（行主序）
+    uint32_t portalIndex;   // 在源门户列表中的下标
+};
+
+struct BatchPortalSet {
+    std::vector<BatchPortal> portals;
+};
+
+/**
+ * 从门户列表构建批量门户集合（仅包含激活且已链接的门户）
+ * 门户变换改变后需要重新构建
+ */
+inline BatchPortalSet BuildBatchPortalSet(const std::vector<PortalRenderer::Portal*>& portals) {
+    BatchPortalSet set;
+    set.portals.reserve(portals.size());
+    for (size_t i = 0; i < portals.size(); i++) {
+        const PortalRenderer::Portal* portal = portals[i];
+        if (!portal->isActive || !portal->linkedPortal) continue;
+
+        const PortalMath::PortalLink& link = portal->GetLink();
+        BatchPortal bp;
+        for (int c = 0; c < 4; c++) {
+            bp.plane[c] = link.sourcePlane[c];
+            bp.localX[c] = link.sourceInverse[c][0];
+            bp.localY[c] = link.sourceInverse[c][1];
+            for (int r = 0; r < 3; r++) {
+                bp.forward[r][c] = link.forward[c][r];
+            }
+        }
+        bp.halfWidth = portal->width * 0.5f;
+        bp.halfHeight = portal->height * 0.5f;
+        bp.portalIndex = (uint32_t)i;
+        set.portals.push_back(bp);
+    }
+    return set;
+}
+
+namespace detail {
+
+// 标量版本：处理 [begin, end) 区间，同时用于 SIMD 路径的尾部
+inline void TeleportBatchScalar(EntityBatch& e, const BatchPortalSet& set, float currentTime,
+                                size_t begin, size_t end,
+                                std::vector<uint32_t>& outCrossed, std::vector<uint32_t>* outPortals) {
+    for (size_t i = begin; i < end; i++) {
+        if (currentTime > 0.0f && (currentTime - e.lastTeleportTime[i]) < TELEPORT_COOLDOWN) continue;
+
+        for (const BatchPortal& bp : set.portals) {
+            float prevDist = bp.plane[0] * e.prevX[i] + bp.plane[1] * e.prevY[i] + bp.plane[2] * e.prevZ[i] + bp.plane[3];
+            float currDist = bp.plane[0] * e.posX[i] + bp.plane[1] * e.posY[i] + bp.plane[2] * e.posZ[i] + bp.plane[3];
+
+            bool crossedPortal = (prevDist > 0.0f && currDist <= 0.0f) ||
+                                 (prevDist < 0.0f && currDist >= 0.0f);
+            if (!crossedPortal) continue;
+
+            float t = prevDist / (prevDist - currDist);
+            float cx = e.prevX[i] + (e.posX[i] - e.prevX[i]) * t;
+            float cy = e.prevY[i] + (e.posY[i] - e.prevY[i]) * t;
+            float cz = e.prevZ[i] + (e.posZ[i] - e.prevZ[i]) * t;
+
+            float lx = bp.localX[0] * cx + bp.localX[1] * cy + bp.localX[2] * cz + bp.localX[3];
+            float ly = bp.localY[0] * cx + bp.localY[1] * cy + bp.localY[2] * cz + bp.localY[3];
+            if (std::abs(lx) > bp.halfWidth || std::abs(ly) > bp.halfHeight) continue;
+
+            const float (*f)[4] = bp.forward;
+            float px = e.posX[i], py = e.posY[i], pz = e.posZ[i];
+            e.posX[i] = f[0][0] * px + f[0][1] * py + f[0][2] * pz + f[0][3];
+            e.posY[i] = f[1][0] * px + f[1][1] * py + f[1][2] * pz + f[1][3];
+            e.posZ[i] = f[2][0] * px + f[2][1] * py + f[2][2] * pz + f[2][3];
+            float qx = e.prevX[i], qy = e.prevY[i], qz = e.prevZ[i];
+            e.prevX[i] = f[0][0] * qx + f[0][1] * qy + f[0][2] * qz + f[0][3];
+            e.prevY[i] = f[1][0] * qx + f[1][1] * qy + f[1][2] * qz + f[1][3];
+            e.prevZ[i] = f[2][0] * qx + f[2][1] * qy + f[2][2] * qz + f[2][3];
+            float vx = e.velX[i], vy = e.velY[i], vz = e.velZ[i];
+            e.velX[i] = f[0][0] * vx + f[0][1] * vy + f[0][2] * vz;
+            e.velY[i] = f[1][0] * vx + f[1][1] * vy + f[1][2] * vz;
+            e.velZ[i] = f[2][0] * vx + f[2][1] * vy + f[2][2] * vz;
+            e.lastTeleportTime[i] = currentTime;
+
+            outCrossed.push_back((uint32_t)i);
+            if (outPortals) outPortals->push_back(bp.portalIndex);
+            break;
+        }
+    }
+}
+
+#if defined(PORTAL_BATCH_AVX2)
+struct SimdAVX2 {
+    using F = __m256;
+    static constexpr int Width = 8;
+    static F Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static F Set1(float v) { return _mm256_set1_ps(v); }
+    static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F And(F a, F b) { return _mm256_and_ps(a, b); }
+    static F Or(F a, F b) { return _mm256_or_ps(a, b); }
+    static F AndNot(F a, F b) { return _mm256_andnot_ps(a, b); }   // ~a & b
+    static F Gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static F Ge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static F Lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static F Le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static F Select(F mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+    static F AllOnes() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static int MoveMask(F m) { return _mm256_movemask_ps(m); }
+};
+#endif
+
+#if defined(PORTAL_BATCH_SSE2)
+struct SimdSSE2 {
+    using F = __m128;
+    static constexpr int Width = 4;
+    static F Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, F v) { _mm_storeu_ps(p, v); }
+    static F Set1(float v) { return _mm_set1_ps(v); }
+    static F Add(F a, F b) { return _mm_add_ps(a, b); }
+    static F Sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F Mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F Div(F a, F b) { return _mm_div_ps(a, b); }
+    static F And(F a, F b) { return _mm_and_ps(a, b); }
+    static F Or(F a, F b) { return _mm_or_ps(a, b); }
+    static F AndNot(F a, F b) { return _mm_andnot_ps(a, b); }       // ~a & b
+    static F Gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static F Ge(F a, F b) { return _mm_cmpge_ps(a, b); }
+    static F Lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static F Le(F a, F b) { return _mm_cmple_ps(a, b); }
+    static F Select(F mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static F AllOnes() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static int MoveMask(F m) { return _mm_movemask_ps(m); }
+};
+#endif
+
+/**
+ * SIMD 内核：每次处理 S::Width 个实体，对所有门户依次测试。
+ * 已传送的通道从 active 掩码中移除（等价于标量循环中的 break）。
+ * 返回已处理的实体数量（Width 的整数倍），剩余部分由调用方走标量路径。
+ */
+template <typename S>
+size_t TeleportBatchSimd(EntityBatch& e, const BatchPortalSet& set, float currentTime,
+                         std::vector<uint32_t>& outCrossed, std::vector<uint32_t>* outPortals) {
+    using F = typename S::F;
+    constexpr int W = S::Width;
+    const size_t count = e.Size();
+    const size_t simdEnd = count - count % W;
+
+    const F zero = S::Set1(0.0f);
+    const F signMask = S::Set1(-0.0f);
+    const F now = S::Set1(currentTime);
+    const F cooldown = S::Set1(TELEPORT_COOLDOWN);
+
+    for (size_t i = 0; i < simdEnd; i += W) {
+        // 冷却检测（currentTime <= 0 时与标量版本一样跳过冷却）
+        F active = S::AllOnes();
+        if (currentTime > 0.0f) {
+            active = S::Ge(S::Sub(now, S::Load(&e.lastTeleportTime[i])), cooldown);
+        }
+        if (S::MoveMask(active) == 0) continue;
+
+        F px = S::Load(&e.posX[i]),  py = S::Load(&e.posY[i]),  pz = S::Load(&e.posZ[i]);
+        F qx = S::Load(&e.prevX[i]), qy = S::Load(&e.prevY[i]), qz = S::Load(&e.prevZ[i]);
+        F vx = S::Load(&e.velX[i]),  vy = S::Load(&e.velY[i]),  vz = S::Load(&e.velZ[i]);
+
+        F teleported = zero;
+        uint32_t laneHitPortal[W] = {};
+
+        for (const BatchPortal& bp : set.portals) {
+            const F nx = S::Set1(bp.plane[0]), ny = S::Set1(bp.plane[1]);
+            const F nz = S::Set1(bp.plane[2]), nw = S::Set1(bp.plane[3]);
+            F prevDist = S::Add(S::Add(S::Add(S::Mul(nx, qx), S::Mul(ny, qy)), S::Mul(nz, qz)), nw);
+            F currDist = S::Add(S::Add(S::Add(S::Mul(nx, px), S::Mul(ny, py)), S::Mul(nz, pz)), nw);
+
+            F crossed = S::Or(S::And(S::Gt(prevDist, zero), S::Le(currDist, zero)),
+                              S::And(S::Lt(prevDist, zero), S::Ge(currDist, zero)));
+            F hit = S::And(active, crossed);
+            if (S::MoveMask(hit) == 0) continue;
+
+            // 交点（未命中通道可能出现 0/0，结果被掩码丢弃）
+            F t = S::Div(prevDist, S::Sub(prevDist, currDist));
+            F cx = S::Add(qx, S::Mul(S::Sub(px, qx), t));
+            F cy = S::Add(qy, S::Mul(S::Sub(py, qy), t));
+            F cz = S::Add(qz, S::Mul(S::Sub(pz, qz), t));
+
+            F lx = S::Add(S::Add(S::Add(S::Mul(S::Set1(bp.localX[0]), cx), S::Mul(S::Set1(bp.localX[1]), cy)),
+                                 S::Mul(S::Set1(bp.localX[2]), cz)), S::Set1(bp.localX[3]));
+            F ly = S::Add(S::Add(S::Add(S::Mul(S::Set1(bp.localY[0]), cx), S::Mul(S::Set1(bp.localY[1]), cy)),
+                                 S::Mul(S::Set1(bp.localY[2]), cz)), S::Set1(bp.localY[3]));
+            F inBounds = S::And(S::Le(S::AndNot(signMask, lx), S::Set1(bp.halfWidth)),
+                                S::Le(S::AndNot(signMask, ly), S::Set1(bp.halfHeight)));
+            hit = S::And(hit, inBounds);
+            int hitBits = S::MoveMask(hit);
+            if (hitBits == 0) continue;
+
+            // 对命中通道应用门户变换
+            const float (*f)[4] = bp.forward;
+            F r[3][4];
+            for (int row = 0; row < 3; row++) {
+                for (int col = 0; col < 4; col++) r[row][col] = S::Set1(f[row][col]);
+            }
+            auto point = [&](int row, F x, F y, F z) {
+                return S::Add(S::Add(S::Add(S::Mul(r[row][0], x), S::Mul(r[row][1], y)), S::Mul(r[row][2], z)), r[row][3]);
+            };
+            auto direction = [&](int row, F x, F y, F z) {
+                return S::Add(S::Add(S::Mul(r[row][0], x), S::Mul(r[row][1], y)), S::Mul(r[row][2], z));
+            };
+            F npx = point(0, px, py, pz), npy = point(1, px, py, pz), npz = point(2, px, py, pz);
+            F nqx = point(0, qx, qy, qz), nqy = point(1, qx, qy, qz), nqz = point(2, qx, qy, qz);
+            F nvx = direction(0, vx, vy, vz), nvy = direction(1, vx, vy, vz), nvz = direction(2, vx, vy, vz);
+            px = S::Select(hit, npx, px); py = S::Select(hit, npy, py); pz = S::Select(hit, npz, pz);
+            qx = S::Select(hit, nqx, qx); qy = S::Select(hit, nqy, qy); qz = S::Select(hit, nqz, qz);
+            vx = S::Select(hit, nvx, vx); vy = S::Select(hit, nvy, vy); vz = S::Select(hit, nvz, vz);
+
+            for (int lane = 0; lane < W; lane++) {
+                if (hitBits & (1 << lane)) laneHitPortal[lane] = bp.portalIndex;
+            }
+            teleported = S::Or(teleported, hit);
+            active = S::AndNot(hit, active);
+            if (S::MoveMask(active) == 0) break;
+        }
+
+        int teleportedBits = S::MoveMask(teleported);
+        if (teleportedBits == 0) continue;
+
+        S::Store(&e.posX[i], px);  S::Store(&e.posY[i], py);  S::Store(&e.posZ[i], pz);
+        S::Store(&e.prevX[i], qx); S::Store(&e.prevY[i], qy); S::Store(&e.prevZ[i], qz);
+        S::Store(&e.velX[i], vx);  S::Store(&e.velY[i], vy);  S::Store(&e.velZ[i], vz);
+        S::Store(&e.lastTeleportTime[i], S::Select(teleported, now, S::Load(&e.lastTeleportTime[i])));
+
+        // 紧凑输出命中索引
+        for (int lane = 0; lane < W; lane++) {
+            if (teleportedBits & (1 << lane)) {
+                outCrossed.push_back((uint32_t)(i + lane));
+                if (outPortals) outPortals->push_back(laneHitPortal[lane]);
+            }
+        }
+    }
+    return simdEnd;
+}
+
+} // namespace detail
+
+/**
+ * 当前编译配置下批量内核使用的指令集名称
+ */
+inline const char* GetBatchKernelName() {
+#if defined(PORTAL_BATCH_AVX2)
+    return "AVX2";
+#elif defined(PORTAL_BATCH_SSE2)
+    return "SSE2";
+#else
+    return "Scalar";
+#endif
+}
+
+/**
+ * 批量穿越检测 + 传送
+ *
+ * @param entities     SoA 实体集合（原地更新位置、上一帧位置、速度、传送时间）
+ * @param portalSet    BuildBatchPortalSet 构建的门户集合
+ * @param currentTime  当前时间（<= 0 时不做冷却检测，同 ShouldTeleport）
+ * @param outCrossed   输出：本次传送的实体下标（升序）
+ * @param outPortals   可选输出：与 outCrossed 一一对应的入口门户下标
+ * @return 传送的实体数量
+ */
+inline size_t TeleportBatch(EntityBatch& entities, const BatchPortalSet& portalSet, float currentTime,
+                            std::vector<uint32_t>& outCrossed, std::vector<uint32_t>* outPortals = nullptr) {
+    outCrossed.clear();
+    if (outPortals) outPortals->clear();
+    if (portalSet.portals.empty()) return 0;
+
+    size_t processed = 0;
+#if defined(PORTAL_BATCH_AVX2)
+    processed = detail::TeleportBatchSimd<detail::SimdAVX2>(entities, portalSet, currentTime, outCrossed, outPortals);
+#elif defined(PORTAL_BATCH_SSE2)
+    processed = detail::TeleportBatchSimd<detail::SimdSSE2>(entities, portalSet, currentTime, outCrossed, outPortals);
+#endif
+    detail::TeleportBatchScalar(entities, portalSet, currentTime, processed, entities.Size(), outCrossed, outPortals);
+    return outCrossed.size();
+}
+
+} // namespace PortalTeleporter
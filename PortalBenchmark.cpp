@@ -0,0 +1,255 @@
+/**
+ * PortalBenchmark.cpp - 门户数学/传送的CPU微基准
+ *
+ * 不需要窗口或GPU，仅测量CPU侧代码：
+ * - 批量传送：逐实体 ShouldTeleport/TeleportEntity 循环 vs SoA 批量内核
+ * - 每视图门户数学：递归深度4、多门户时 mat4 / PortalLink / RigidTransform 的开销
+ *
+ * 用法: PortalBenchmark [实体数量] [迭代次数]
+ */
+
+#include "PortalMath.h"
+#include "PortalRenderer.h"
+#include "PortalTeleporter.h"
+#include "PortalBatchTeleporter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// 创建 pairCount 对互相链接的门户，沿 X 轴排列，朝向交替
+std::vector<PortalRenderer::Portal*> CreatePortalPairs(int pairCount) {
+    std::vector<PortalRenderer::Portal*> portals;
+    for (int i = 0; i < pairCount; i++) {
+        PortalRenderer::Portal* a = new PortalRenderer::Portal();
+        PortalRenderer::Portal* b = new PortalRenderer::Portal();
+        glm::mat4 ta = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f + i * 12.0f, 1.5f, 0.0f));
+        ta = glm::rotate(ta, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 tb = glm::translate(glm::mat4(1.0f), glm::vec3(5.0f + i * 12.0f, 1.5f, -10.0f));
+        tb = glm::rotate(tb, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        a->SetTransform(ta);
+        b->SetTransform(tb);
+        a->linkedPortal = b;
+        b->linkedPortal = a;
+        portals.push_back(a);
+        portals.push_back(b);
+    }
+    return portals;
+}
+
+// 在门户附近随机生成实体，速度足以让一部分实体在本帧穿过门户平面
+void GenerateEntities(const std::vector<PortalRenderer::Portal*>& portals, size_t count, float dt,
+                      std::vector<PortalTeleporter::TeleportableEntity>& aos,
+                      PortalTeleporter::EntityBatch& soa) {
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> speed(-30.0f, 30.0f);
+    std::uniform_int_distribution<size_t> pick(0, portals.size() - 1);
+
+    aos.resize(count);
+    soa.Resize(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center = portals[pick(rng)]->GetPosition();
+        glm::vec3 prev = center + glm::vec3(offset(rng), offset(rng), offset(rng));
+        glm::vec3 vel(speed(rng), speed(rng) * 0.1f, speed(rng));
+        glm::vec3 pos = prev + vel * dt;
+
+        PortalTeleporter::TeleportableEntity& e = aos[i];
+        e.previousPosition = prev;
+        e.position = pos;
+        e.velocity = vel;
+        e.transform = glm::translate(glm::mat4(1.0f), pos);
+        e.lastTeleportTime = -1.0f;
+
+        soa.prevX[i] = prev.x; soa.prevY[i] = prev.y; soa.prevZ[i] = prev.z;
+        soa.posX[i] = pos.x;   soa.posY[i] = pos.y;   soa.posZ[i] = pos.z;
+        soa.velX[i] = vel.x;   soa.velY[i] = vel.y;   soa.velZ[i] = vel.z;
+        soa.lastTeleportTime[i] = -1.0f;
+    }
+}
+
+void BenchmarkBatchTeleport(size_t entityCount, int iterations) {
+    const float dt = 1.0f / 60.0f;
+    const float currentTime = 10.0f;
+
+    std::vector<PortalRenderer::Portal*> portals = CreatePortalPairs(4);
+
+    std::vector<PortalTeleporter::TeleportableEntity> aosTemplate;
+    PortalTeleporter::EntityBatch soaTemplate;
+    GenerateEntities(portals, entityCount, dt, aosTemplate, soaTemplate);
+
+    // 逐实体标量循环（与 main_example.cpp 中 UpdatePlayer 相同的调用方式）
+    double scalarMs = 0.0;
+    size_t scalarHits = 0;
+    for (int it = 0; it < iterations; it++) {
+        std::vector<PortalTeleporter::TeleportableEntity> aos = aosTemplate;
+        Clock::time_point start = Clock::now();
+        scalarHits = 0;
+        for (PortalTeleporter::TeleportableEntity& e : aos) {
+            for (PortalRenderer::Portal* portal : portals) {
+                if (!portal->isActive || !portal->linkedPortal) continue;
+                if (PortalTeleporter::ShouldTeleport(e, portal, portal->width / 2.0f, portal->height / 2.0f, currentTime)) {
+                    PortalTeleporter::TeleportEntity(e, portal, portal->linkedPortal);
+                    scalarHits++;
+                    break;
+                }
+            }
+        }
+        scalarMs += ElapsedMs(start);
+    }
+
+    // SoA 批量内核
+    PortalTeleporter::BatchPortalSet portalSet = PortalTeleporter::BuildBatchPortalSet(portals);
+    std::vector<uint32_t> crossed;
+    crossed.reserve(entityCount);
+    double batchMs = 0.0;
+    for (int it = 0; it < iterations; it++) {
+        PortalTeleporter::EntityBatch soa = soaTemplate;
+        Clock::time_point start = Clock::now();
+        PortalTeleporter::TeleportBatch(soa, portalSet, currentTime, crossed);
+        batchMs += ElapsedMs(start);
+    }
+
+    scalarMs /= iterations;
+    batchMs /= iterations;
+    printf("[Batch Teleport] entities=%zu portals=%zu kernel=%s\n",
+           entityCount, portals.size(), PortalTeleporter::GetBatchKernelName());
+    printf("  per-entity loop : %8.3f ms  (%6.2f ns/entity)  crossed=%zu\n",
+           scalarMs, scalarMs * 1e6 / entityCount, scalarHits);
+    printf("  SoA batch kernel: %8.3f ms  (%6.2f ns/entity)  crossed=%zu\n",
+           batchMs, batchMs * 1e6 / entityCount, crossed.size());
+    printf("  speedup         : %8.2fx\n", batchMs > 0.0 ? scalarMs / batchMs : 0.0);
+    if (scalarHits != crossed.size()) {
+        printf("  WARNING: crossed count mismatch (%zu vs %zu)\n", scalarHits, crossed.size());
+    }
+
+    for (PortalRenderer::Portal* portal : portals) delete portal;
+}
+
+// ============================================================================
+// 每视图门户数学（模拟 RenderPortalContent 的递归遍历，不含GL调用）
+// 每个视图：虚拟视图、虚拟相机位置/前向、出口平面（视图空间）
+// ============================================================================
+
+struct ViewMathStats {
+    size_t views = 0;
+    float checksum = 0.0f;  // 防止编译器优化掉计算
+};
+
+// 基线：每次调用都构造 rotate180 并对矩阵求逆（未缓存门户对变换时的写法）
+void TraverseMat4Uncached(const std::vector<PortalRenderer::Portal*>& portals, const glm::mat4& view,
+                          const PortalRenderer::Portal* exclude, int depth, int maxDepth, ViewMathStats& stats) {
+    if (depth >= maxDepth) return;
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
+    for (const PortalRenderer::Portal* portal : portals) {
+        if (exclude && (portal == exclude || portal == exclude->linkedPortal)) continue;
+        const glm::mat4& src = portal->transform;
+        const glm::mat4& dst = portal->linkedPortal->transform;
+        glm::mat4 virtualView = PortalMath::CalculatePortalViewMatrix(view, src, dst);
+        glm::mat4 portalTransform = PortalMath::ComputePortalTransform(src, dst);
+        glm::vec3 virtualCameraPos = glm::vec3(portalTransform * glm::vec4(cameraPos, 1.0f));
+        glm::vec3 clipPos = glm::vec3(virtualView * glm::vec4(glm::vec3(dst[3]), 1.0f));
+        glm::vec3 clipNormal = glm::normalize(glm::vec3(virtualView * glm::vec4(glm::vec3(dst[2]), 0.0f)));
+        glm::vec3 forward = -glm::normalize(glm::vec3(glm::inverse(virtualView)[2]));
+        stats.checksum += virtualCameraPos.x + clipPos.z + clipNormal.z + forward.y + virtualView[3][2];
+        stats.views++;
+        TraverseMat4Uncached(portals, virtualView, portal, depth + 1, maxDepth, stats);
+    }
+}
+
+// mat4 + PortalLink 缓存
+void TraverseMat4Linked(const std::vector<PortalRenderer::Portal*>& portals, const glm::mat4& view,
+                        const PortalRenderer::Portal* exclude, int depth, int maxDepth, ViewMathStats& stats) {
+    if (depth >= maxDepth) return;
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
+    for (const PortalRenderer::Portal* portal : portals) {
+        if (exclude && (portal == exclude || portal == exclude->linkedPortal)) continue;
+        const PortalMath::PortalLink& link = portal->GetLink();
+        glm::mat4 virtualView = PortalMath::CalculatePortalViewMatrix(view, link);
+        glm::vec3 virtualCameraPos = PortalMath::TeleportPosition(cameraPos, link);
+        glm::vec3 clipPos = glm::vec3(virtualView * glm::vec4(link.targetPosition, 1.0f));
+        glm::vec3 clipNormal = glm::normalize(glm::vec3(virtualView * glm::vec4(link.targetForward, 0.0f)));
+        glm::vec3 forward = -glm::normalize(glm::vec3(glm::inverse(virtualView)[2]));
+        stats.checksum += virtualCameraPos.x + clipPos.z + clipNormal.z + forward.y + virtualView[3][2];
+        stats.views++;
+        TraverseMat4Linked(portals, virtualView, portal, depth + 1, maxDepth, stats);
+    }
+}
+
+// RigidTransform + PortalLink（当前 RenderPortalContent 的写法，含一次 ToMatrix 上传转换）
+void TraverseRigid(const std::vector<PortalRenderer::Portal*>& portals, const PortalMath::RigidTransform& view,
+                   const PortalRenderer::Portal* exclude, int depth, int maxDepth, ViewMathStats& stats) {
+    if (depth >= maxDepth) return;
+    glm::vec3 cameraPos = PortalMath::GetCameraPosition(view);
+    for (const PortalRenderer::Portal* portal : portals) {
+        if (exclude && (portal == exclude || portal == exclude->linkedPortal)) continue;
+        const PortalMath::PortalLink& link = portal->GetLink();
+        PortalMath::RigidTransform virtualView = PortalMath::CalculatePortalViewMatrix(view, link);
+        glm::mat4 virtualViewMatrix = virtualView.ToMatrix();
+        glm::vec3 virtualCameraPos = PortalMath::TeleportPosition(cameraPos, link);
+        glm::vec3 clipPos = virtualView.TransformPoint(link.targetPosition);
+        glm::vec3 clipNormal = glm::normalize(virtualView.TransformDirection(link.targetForward));
+        glm::vec3 forward = PortalMath::GetCameraForward(virtualView);
+        stats.checksum += virtualCameraPos.x + clipPos.z + clipNormal.z + forward.y + virtualViewMatrix[3][2];
+        stats.views++;
+        TraverseRigid(portals, virtualView, portal, depth + 1, maxDepth, stats);
+    }
+}
+
+void BenchmarkViewMath(int pairCount, int maxDepth, int iterations) {
+    std::vector<PortalRenderer::Portal*> portals = CreatePortalPairs(pairCount);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.7f, 5.0f), glm::vec3(0.0f, 1.7f, 4.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    PortalMath::RigidTransform rigidView = PortalMath::RigidTransform::FromMatrix(view);
+
+    struct Variant { const char* name; double ms; ViewMathStats stats; };
+    Variant variants[3] = { { "mat4 (uncached)", 0.0, {} }, { "mat4 + PortalLink", 0.0, {} }, { "RigidTransform", 0.0, {} } };
+
+    for (int it = 0; it < iterations; it++) {
+        Clock::time_point start = Clock::now();
+        variants[0].stats = {};
+        TraverseMat4Uncached(portals, view, nullptr, 0, maxDepth, variants[0].stats);
+        variants[0].ms += ElapsedMs(start);
+
+        start = Clock::now();
+        variants[1].stats = {};
+        TraverseMat4Linked(portals, view, nullptr, 0, maxDepth, variants[1].stats);
+        variants[1].ms += ElapsedMs(start);
+
+        start = Clock::now();
+        variants[2].stats = {};
+        TraverseRigid(portals, rigidView, nullptr, 0, maxDepth, variants[2].stats);
+        variants[2].ms += ElapsedMs(start);
+    }
+
+    printf("[View Math] portals=%zu depth=%d views=%zu\n", portals.size(), maxDepth, variants[0].stats.views);
+    for (Variant& v : variants) {
+        v.ms /= iterations;
+        printf("  %-18s: %8.3f ms  (%6.1f ns/view)  checksum=%.1f\n",
+               v.name, v.ms, v.ms * 1e6 / (double)v.stats.views, v.stats.checksum);
+    }
+
+    for (PortalRenderer::Portal* portal : portals) delete portal;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t entityCount = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 50000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 50;
+    if (entityCount == 0) entityCount = 1;
+    if (iterations <= 0) iterations = 1;
+
+    BenchmarkBatchTeleport(entityCount, iterations);
+    BenchmarkViewMath(8, PortalRenderer::MAX_PORTAL_RECURSION, 5);
+    return 0;
+}
@@ -0,0 +1,367 @@
+/**
+ * PortalCulling.h - 门户视图的CPU裁剪
+ *
+ * 提供世界空间视锥体、包围盒测试，以及"门户孔径视锥体"：
+ * 从相机位置穿过门户四边形（已被父视图孔径裁剪过）的各条边构成侧平面，
+ * 以出口门户平面作为近平面。嵌套门户可见性和场景物体剔除都基于它，
+ * 门户孔径之外的几何体不会被提交。
+ * 静态物体放在按表面积启发式（SAH）构建的 BVH 中，每个视图用自己的裁剪体遍历。
+ *
+ * 约定：平面 (n, d) 满足 dot(n, p) + d >= 0 的点在内侧。
+ */
+
+#pragma once
+
+#include "PortalMath.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace PortalCulling {
+
+// 裁剪后多边形的最大顶点数（超出时保留未裁剪的输入，保证结果保守）
+constexpr int MAX_APERTURE_VERTICES = 32;
+// 视锥体最大平面数：孔径每条边一个侧平面 + 近平面
+constexpr int MAX_FRUSTUM_PLANES = MAX_APERTURE_VERTICES + 1;
+
+/**
+ * 凸多边形（世界空间，顶点按边顺序排列）
+ */
+struct ConvexPolygon {
+    glm::vec3 vertices[MAX_APERTURE_VERTICES];
+    int count = 0;
+
+    bool IsEmpty() const { return count < 3; }
+};
+
+/**
+ * 凸裁剪体：一组世界空间平面
+ */
+struct Frustum {
+    glm::vec4 planes[MAX_FRUSTUM_PLANES];
+    int planeCount = 0;
+
+    void AddPlane(const glm::vec4& plane) {
+        if (planeCount < MAX_FRUSTUM_PLANES) planes[planeCount++] = plane;
+    }
+};
+
+/**
+ * 从 projection × view 提取6个世界空间视锥平面（Gribb-Hartmann）
+ */
+inline Frustum ExtractFrustum(const glm::mat4& viewProjection) {
+    glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+    Frustum f;
+    f.AddPlane(row3 + row0);  // 左
+    f.AddPlane(row3 - row0);  // 右
+    f.AddPlane(row3 + row1);  // 下
+    f.AddPlane(row3 - row1);  // 上
+    f.AddPlane(row3 + row2);  // 近
+    f.AddPlane(row3 - row2);  // 远
+    return f;
+}
+
+/**
+ * 轴对齐包围盒与视锥体的相交测试（保守：可能把外面的判为可见，不会误剔除）
+ */
+inline bool IntersectsAABB(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    for (int i = 0; i < frustum.planeCount; i++) {
+        const glm::vec4& p = frustum.planes[i];
+        // 取沿平面法线方向最远的顶点
+        glm::vec3 positive(p.x >= 0.0f ? boundsMax.x : boundsMin.x,
+                           p.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                           p.z >= 0.0f ? boundsMax.z : boundsMin.z);
+        if (glm::dot(glm::vec3(p), positive) + p.w < 0.0f) return false;
+    }
+    return true;
+}
+
+/**
+ * 用视锥体的所有平面裁剪凸多边形（Sutherland-Hodgman）
+ * 相当于把门户四边形与父视图的孔径多边形求交
+ */
+inline ConvexPolygon ClipPolygon(const ConvexPolygon& polygon, const Frustum& frustum) {
+    ConvexPolygon current = polygon;
+    for (int i = 0; i < frustum.planeCount && !current.IsEmpty(); i++) {
+        const glm::vec4& plane = frustum.planes[i];
+        ConvexPolygon clipped;
+        bool overflow = false;
+        for (int v = 0; v < current.count; v++) {
+            const glm::vec3& a = current.vertices[v];
+            const glm::vec3& b = current.vertices[(v + 1) % current.count];
+            float da = glm::dot(glm::vec3(plane), a) + plane.w;
+            float db = glm::dot(glm::vec3(plane), b) + plane.w;
+            if (da >= 0.0f) {
+                if (clipped.count == MAX_APERTURE_VERTICES) { overflow = true; break; }
+                clipped.vertices[clipped.count++] = a;
+            }
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                if (clipped.count == MAX_APERTURE_VERTICES) { overflow = true; break; }
+                clipped.vertices[clipped.count++] = glm::mix(a, b, da / (da - db));
+            }
+        }
+        if (overflow) continue;  // 保守：跳过这个平面
+        current = clipped;
+    }
+    if (current.IsEmpty()) current.count = 0;
+    return current;
+}
+
+/**
+ * 门户四边形的世界空间顶点（局部 z=0，逆时针）
+ */
+inline ConvexPolygon GetPortalPolygon(const glm::mat4& portalTransform, float halfWidth, float halfHeight) {
+    ConvexPolygon polygon;
+    polygon.vertices[0] = glm::vec3(portalTransform * glm::vec4(-halfWidth, -halfHeight, 0.0f, 1.0f));
+    polygon.vertices[1] = glm::vec3(portalTransform * glm::vec4( halfWidth, -halfHeight, 0.0f, 1.0f));
+    polygon.vertices[2] = glm::vec3(portalTransform * glm::vec4( halfWidth,  halfHeight, 0.0f, 1.0f));
+    polygon.vertices[3] = glm::vec3(portalTransform * glm::vec4(-halfWidth,  halfHeight, 0.0f, 1.0f));
+    polygon.count = 4;
+    return polygon;
+}
+
+/**
+ * 用刚体/仿射变换把多边形变换到另一侧（如 PortalLink::forward）
+ */
+inline ConvexPolygon TransformPolygon(const ConvexPolygon& polygon, const glm::mat4& transform) {
+    ConvexPolygon result;
+    result.count = polygon.count;
+    for (int i = 0; i < polygon.count; i++) {
+        result.vertices[i] = glm::vec3(transform * glm::vec4(polygon.vertices[i], 1.0f));
+    }
+    return result;
+}
+
+/**
+ * 构建门户孔径视锥体
+ *
+ * @param cameraPos   （虚拟）相机世界位置
+ * @param aperture    孔径多边形（与相机处于同一世界空间，通常是已裁剪、已传送到出口侧的门户四边形）
+ * @param nearPlane   近平面（出口门户平面），方向会被调整为相机在外侧
+ */
+inline Frustum BuildApertureFrustum(const glm::vec3& cameraPos, const ConvexPolygon& aperture, const glm::vec4& nearPlane) {
+    Frustum f;
+    if (aperture.IsEmpty()) return f;
+
+    glm::vec3 centroid(0.0f);
+    for (int i = 0; i < aperture.count; i++) centroid += aperture.vertices[i];
+    centroid /= (float)aperture.count;
+
+    // 侧平面：相机 + 孔径的每条边
+    for (int i = 0; i < aperture.count; i++) {
+        glm::vec3 a = aperture.vertices[i] - cameraPos;
+        glm::vec3 b = aperture.vertices[(i + 1) % aperture.count] - cameraPos;
+        glm::vec3 n = glm::cross(a, b);
+        float len = glm::length(n);
+        if (len < 1e-6f) continue;  // 退化边（长度为0或与相机共线）
+        n /= len;
+        if (glm::dot(n, centroid - cameraPos) < 0.0f) n = -n;
+        f.AddPlane(glm::vec4(n, -glm::dot(n, cameraPos)));
+    }
+
+    // 近平面：保留门户后方（远离相机的一侧）
+    glm::vec4 plane = nearPlane;
+    if (glm::dot(glm::vec3(plane), cameraPos) + plane.w > 0.0f) plane = -plane;
+    f.AddPlane(plane);
+    return f;
+}
+
+// ============================================================================
+//                          静态物体 BVH
+// ============================================================================
+
+// SAH 分桶数
+constexpr int BVH_SAH_BINS = 12;
+// 物体数不超过此值时直接成为叶子
+constexpr int BVH_MAX_LEAF_ITEMS = 2;
+// SAH 代价中一次遍历（包围盒测试）相对一次物体测试的代价
+constexpr float BVH_TRAVERSAL_COST = 1.0f;
+// 最大深度：更深的节点直接成为叶子，遍历栈的大小据此固定
+constexpr int BVH_MAX_DEPTH = 48;
+
+struct BvhNode {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    int first = 0;      // 叶子：items 中的起始下标；内部节点：左子节点下标（右子节点紧随其后）
+    int count = 0;      // 叶子的物体数；内部节点为 0
+};
+
+/**
+ * 静态物体的包围体层次
+ * Build 按物体包围盒的质心分桶求 SAH 最小代价的划分；Query 用裁剪体遍历，
+ * 节点完全在某个平面内侧后子树不再测试该平面，完全在全部平面内侧的子树整棵接受
+ */
+struct Bvh {
+    std::vector<BvhNode> nodes;     // nodes[0] 为根
+    std::vector<int> items;         // 叶子引用的物体下标
+    std::vector<glm::vec3> itemMin; // 物体包围盒（与 items 平行，叶子内逐个测试）
+    std::vector<glm::vec3> itemMax;
+
+    void Build(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax) {
+        nodes.clear();
+        items.resize(boundsMin.size());
+        for (size_t i = 0; i < items.size(); i++) items[i] = (int)i;
+        if (items.empty()) return;
+        nodes.reserve(items.size() * 2);
+        nodes.emplace_back();
+        Subdivide(0, 0, (int)items.size(), 0, boundsMin, boundsMax);
+        itemMin.resize(items.size());
+        itemMax.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            itemMin[i] = boundsMin[items[i]];
+            itemMax[i] = boundsMax[items[i]];
+        }
+    }
+
+    /**
+     * 对与裁剪体相交的每个物体调用 visit(物体下标)，结果与逐个 IntersectsAABB 相同
+     * @return 访问的节点数
+     */
+    template<typename Visit>
+    int Query(const Frustum& frustum, Visit visit) const {
+        if (nodes.empty()) return 0;
+        struct Entry { int node; uint64_t planes; };
+        Entry stack[BVH_MAX_DEPTH + 2];
+        int top = 0;
+        int visited = 0;
+        uint64_t all = frustum.planeCount >= 64 ? ~0ull : (1ull << frustum.planeCount) - 1;
+        stack[top++] = { 0, all };
+        while (top > 0) {
+            Entry entry = stack[--top];
+            const BvhNode& node = nodes[entry.node];
+            visited++;
+            uint64_t planes = entry.planes;
+            if (!Classify(frustum, node.boundsMin, node.boundsMax, planes)) continue;
+            if (node.count > 0) {
+                for (int i = node.first; i < node.first + node.count; i++) {
+                    uint64_t itemPlanes = planes;
+                    if (planes == 0 || Classify(frustum, itemMin[i], itemMax[i], itemPlanes)) visit(items[i]);
+                }
+            } else {
+                stack[top++] = { node.first + 1, planes };
+                stack[top++] = { node.first, planes };
+            }
+        }
+        return visited;
+    }
+
+private:
+    // 用 planes 中的平面测试包围盒：完全在某个平面外侧时返回 false；完全在内侧的平面从 planes 中清除
+    static bool Classify(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+                         uint64_t& planes) {
+        for (uint64_t bits = planes; bits != 0; bits &= bits - 1) {
+            int i = CountTrailingZeros(bits);
+            const glm::vec4& p = frustum.planes[i];
+            glm::vec3 positive(p.x >= 0.0f ? boundsMax.x : boundsMin.x,
+                               p.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                               p.z >= 0.0f ? boundsMax.z : boundsMin.z);
+            if (glm::dot(glm::vec3(p), positive) + p.w < 0.0f) return false;
+            glm::vec3 negative(p.x >= 0.0f ? boundsMin.x : boundsMax.x,
+                               p.y >= 0.0f ? boundsMin.y : boundsMax.y,
+                               p.z >= 0.0f ? boundsMin.z : boundsMax.z);
+            if (glm::dot(glm::vec3(p), negative) + p.w >= 0.0f) planes &= ~(1ull << i);
+        }
+        return true;
+    }
+
+    static int CountTrailingZeros(uint64_t bits) {
+        int n = 0;
+        while (!(bits & 1)) { bits >>= 1; n++; }
+        return n;
+    }
+
+    static float SurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        glm::vec3 e = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    void Subdivide(int nodeIndex, int first, int count, int depth,
+                   const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax) {
+        glm::vec3 nodeMin(boundsMin[items[first]]), nodeMax(boundsMax[items[first]]);
+        glm::vec3 centroidMin((nodeMin + nodeMax) * 0.5f), centroidMax(centroidMin);
+        for (int i = first; i < first + count; i++) {
+            int item = items[i];
+            nodeMin = glm::min(nodeMin, boundsMin[item]);
+            nodeMax = glm::max(nodeMax, boundsMax[item]);
+            glm::vec3 c = (boundsMin[item] + boundsMax[item]) * 0.5f;
+            centroidMin = glm::min(centroidMin, c);
+            centroidMax = glm::max(centroidMax, c);
+        }
+        nodes[nodeIndex].boundsMin = nodeMin;
+        nodes[nodeIndex].boundsMax = nodeMax;
+        nodes[nodeIndex].first = first;
+        nodes[nodeIndex].count = count;
+        if (count <= BVH_MAX_LEAF_ITEMS || depth >= BVH_MAX_DEPTH) return;
+
+        // 按质心分桶，逐轴求 SAH 代价最小的划分
+        float bestCost = (float)count;      // 不划分（叶子）的代价，按节点面积归一化
+        int bestAxis = -1, bestSplit = 0;
+        float nodeArea = SurfaceArea(nodeMin, nodeMax);
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f) continue;
+            struct Bin { glm::vec3 boundsMin{ 1e30f }, boundsMax{ -1e30f }; int count = 0; };
+            Bin bins[BVH_SAH_BINS];
+            for (int i = first; i < first + count; i++) {
+                int item = items[i];
+                float c = (boundsMin[item][axis] + boundsMax[item][axis]) * 0.5f;
+                int b = std::min(BVH_SAH_BINS - 1, (int)((c - centroidMin[axis]) / extent * BVH_SAH_BINS));
+                bins[b].boundsMin = glm::min(bins[b].boundsMin, boundsMin[item]);
+                bins[b].boundsMax = glm::max(bins[b].boundsMax, boundsMax[item]);
+                bins[b].count++;
+            }
+            // 从右向左累积右侧的面积和数量，再从左向右扫描
+            float rightArea[BVH_SAH_BINS];
+            int rightCount[BVH_SAH_BINS];
+            Bin accum;
+            for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+                accum.boundsMin = glm::min(accum.boundsMin, bins[b].boundsMin);
+                accum.boundsMax = glm::max(accum.boundsMax, bins[b].boundsMax);
+                accum.count += bins[b].count;
+                rightArea[b] = accum.count > 0 ? SurfaceArea(accum.boundsMin, accum.boundsMax) : 0.0f;
+                rightCount[b] = accum.count;
+            }
+            accum = Bin();
+            for (int b = 0; b < BVH_SAH_BINS - 1; b++) {
+                accum.boundsMin = glm::min(accum.boundsMin, bins[b].boundsMin);
+                accum.boundsMax = glm::max(accum.boundsMax, bins[b].boundsMax);
+                accum.count += bins[b].count;
+                if (accum.count == 0 || rightCount[b + 1] == 0) continue;
+                float cost = BVH_TRAVERSAL_COST +
+                    (SurfaceArea(accum.boundsMin, accum.boundsMax) * accum.count +
+                     rightArea[b + 1] * rightCount[b + 1]) / std::max(nodeArea, 1e-12f);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+        if (bestAxis < 0) return;
+
+        float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+        int* middle = std::partition(items.data() + first, items.data() + first + count, [&](int item) {
+            float c = (boundsMin[item][bestAxis] + boundsMax[item][bestAxis]) * 0.5f;
+            int b = std::min(BVH_SAH_BINS - 1, (int)((c - centroidMin[bestAxis]) / extent * BVH_SAH_BINS));
+            return b <= bestSplit;
+        });
+        int leftCount = (int)(middle - (items.data() + first));
+        if (leftCount == 0 || leftCount == count) return;
+
+        int left = (int)nodes.size();
+        nodes.emplace_back();
+        nodes.emplace_back();
+        nodes[nodeIndex].first = left;
+        nodes[nodeIndex].count = 0;
+        Subdivide(left, first, leftCount, depth + 1, boundsMin, boundsMax);
+        Subdivide(left + 1, first + leftCount, count - leftCount, depth + 1, boundsMin, boundsMax);
+    }
+};
+
+} // namespace PortalCulling
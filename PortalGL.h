@@ -0,0 +1,417 @@
+/**
+ * PortalGL.h - 着色器程序封装与每视图 uniform 缓冲环
+ *
+ * ShaderProgram 在链接时一次性解析 uniform 位置并把 ViewBlock 绑定到固定绑定点，
+ * 绘制时不再按字符串查找。每个视图的 view/projection/相机/时间只写入一次
+ * UniformRing（std140），绘制前按偏移绑定对应区段。
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+namespace PortalGL {
+
+// ============================================================================
+//                          每视图 uniform 数据
+// ============================================================================
+
+// ViewBlock 的绑定点（所有程序共用）
+constexpr GLuint VIEW_BLOCK_BINDING = 0;
+
+/**
+ * 每个视图一份的 uniform 数据，布局与 GLSL 中的 ViewBlock (std140) 一致
+ */
+struct ViewUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 skyViewProjection;    // 去掉平移的 projection * view（天空盒）
+    glm::vec4 cameraPosTime;        // xyz = 相机世界位置, w = 时间（秒）
+};
+static_assert(sizeof(ViewUniforms) == 4 * 64 + 16, "ViewUniforms must match std140 ViewBlock");
+
+inline ViewUniforms MakeViewUniforms(const glm::mat4& view, const glm::mat4& projection,
+                                     const glm::vec3& cameraPos, float time) {
+    ViewUniforms u;
+    u.view = view;
+    u.projection = projection;
+    u.viewProjection = projection * view;
+    u.skyViewProjection = projection * glm::mat4(glm::mat3(view));
+    u.cameraPosTime = glm::vec4(cameraPos, time);
+    return u;
+}
+
+// 着色器版本行 + ViewBlock 声明，由 ShaderProgram::Build 拼在每个着色器源码之前
+inline const char* GetShaderPrelude() {
+    return R"(#version 330 core
+layout(std140) uniform ViewBlock {
+    mat4 uView;
+    mat4 uProjection;
+    mat4 uViewProjection;
+    mat4 uSkyViewProjection;
+    vec4 uCameraPosTime;
+};
+)";
+}
+
+// ============================================================================
+//                          着色器程序
+// ============================================================================
+
+// 绘制时仍需单独上传的 uniform（其余都在 ViewBlock 中）
+enum UniformSlot {
+    UNIFORM_MODEL,
+    UNIFORM_PORTAL_COLOR,
+    UNIFORM_DEQUANTIZE,
+    UNIFORM_FLOOR_TILE_SIZE,
+    UNIFORM_FLOOR_COLOR_LIGHT,
+    UNIFORM_FLOOR_COLOR_DARK,
+    UNIFORM_SKY_CUBEMAP,
+    UNIFORM_FRAME_INSTANCES,
+    UNIFORM_FRAME_INDICES,
+    UNIFORM_FRAME_INDEX_OFFSET,
+    UNIFORM_SLOT_COUNT
+};
+
+inline const char* GetUniformSlotName(UniformSlot slot) {
+    static const char* const names[UNIFORM_SLOT_COUNT] = {
+        "uModel",
+        "uPortalColor",
+        "uDequantize",
+        "uFloorTileSize",
+        "uFloorColorLight",
+        "uFloorColorDark",
+        "uSkyCubemap",
+        "uFrameInstances",
+        "uFrameIndices",
+        "uFrameIndexOffset",
+    };
+    return names[slot];
+}
+
+/**
+ * 着色器程序：链接时解析全部 uniform 位置（程序中不存在的为 -1，上传时被 GL 忽略）
+ */
+struct ShaderProgram {
+    GLuint id = 0;
+    GLint locations[UNIFORM_SLOT_COUNT] = {};
+
+    GLint operator[](UniformSlot slot) const { return locations[slot]; }
+
+    /**
+     * 编译并链接程序。源码不含 #version，前面会拼上 GetShaderPrelude()
+     * @return 编译或链接失败时返回 false（错误日志输出到 std::cerr）
+     */
+    bool Build(const char* name, const char* vertexSource, const char* fragmentSource) {
+        auto compileShader = [name](GLenum type, const char* source) -> GLuint {
+            const char* sources[2] = { GetShaderPrelude(), source };
+            GLuint shader = glCreateShader(type);
+            glShaderSource(shader, 2, sources, nullptr);
+            glCompileShader(shader);
+
+            GLint success;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success) {
+                char infoLog[512];
+                glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+                std::cerr << "Shader compile failed (" << name << "): " << infoLog << std::endl;
+            }
+            return shader;
+        };
+
+        GLuint vertShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+        GLuint fragShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+        id = glCreateProgram();
+        glAttachShader(id, vertShader);
+        glAttachShader(id, fragShader);
+        glLinkProgram(id);
+        glDeleteShader(vertShader);
+        glDeleteShader(fragShader);
+
+        GLint success;
+        glGetProgramiv(id, GL_LINK_STATUS, &success);
+        if (!success) {
+            char infoLog[512];
+            glGetProgramInfoLog(id, 512, nullptr, infoLog);
+            std::cerr << "Shader link failed (" << name << "): " << infoLog << std::endl;
+            return false;
+        }
+
+        GLuint blockIndex = glGetUniformBlockIndex(id, "ViewBlock");
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(id, blockIndex, VIEW_BLOCK_BINDING);
+        }
+        for (int i = 0; i < UNIFORM_SLOT_COUNT; i++) {
+            locations[i] = glGetUniformLocation(id, GetUniformSlotName((UniformSlot)i));
+        }
+        return true;
+    }
+
+    void Destroy() {
+        if (id) glDeleteProgram(id);
+        *this = ShaderProgram();
+    }
+};
+
+// ============================================================================
+//                          uniform 缓冲环
+// ============================================================================
+
+/**
+ * 每帧的 ViewUniforms 环形缓冲
+ *
+ * BeginFrame 孤立（orphan）上一帧的存储，之后每个视图 Push 一次、得到偏移，
+ * 绘制前 Bind(偏移) 把该区段绑定到 VIEW_BLOCK_BINDING。
+ * 容量不足时扩容并复制已写入的数据，本帧之前返回的偏移仍然有效。
+ */
+struct UniformRing {
+    GLuint buffer = 0;
+    GLsizeiptr stride = 0;          // 每个视图占用的字节数（按 UBO 偏移对齐）
+    int capacity = 0;               // 可容纳的视图数
+    int count = 0;                  // 本帧已写入的视图数
+
+    void Create(int initialCapacity) {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = ((GLsizeiptr)sizeof(ViewUniforms) + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &buffer);
+        capacity = initialCapacity;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, stride * capacity, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // 帧开始：孤立旧存储（GPU 仍在读的上一帧数据不受影响），可按已知视图数预留容量
+    void BeginFrame(int expectedViews = 0) {
+        if (expectedViews > capacity) capacity = expectedViews;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, stride * capacity, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        count = 0;
+    }
+
+    // 写入一个视图的数据，返回其字节偏移
+    GLintptr Push(const ViewUniforms& uniforms) {
+        if (count == capacity) Grow(capacity * 2);
+        GLintptr offset = stride * count++;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(ViewUniforms), &uniforms);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        return offset;
+    }
+
+    void Bind(GLintptr offset) const {
+        glBindBufferRange(GL_UNIFORM_BUFFER, VIEW_BLOCK_BINDING, buffer, offset, sizeof(ViewUniforms));
+    }
+
+    void Destroy() {
+        if (buffer) glDeleteBuffers(1, &buffer);
+        *this = UniformRing();
+    }
+
+private:
+    void Grow(int newCapacity) {
+        GLuint newBuffer = 0;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, stride * newCapacity, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, stride * count);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = newBuffer;
+        capacity = newCapacity;
+    }
+};
+
+// ============================================================================
+//                          GL 状态缓存
+// ============================================================================
+
+/**
+ * 状态切换计数
+ */
+struct StateCounters {
+    int issued = 0;         // 实际调用 GL 的次数
+    int suppressed = 0;     // 与当前值相同而被省略的次数
+};
+
+/**
+ * GL 状态影子缓存
+ *
+ * 渲染路径的 glEnable/glDisable、颜色/深度/模板状态、程序、VAO 和裁剪矩形都经由它设置，
+ * 与影子值相同的调用不会到达驱动。初始时所有状态都是"未知"，第一次设置总会发出。
+ * 渲染开始后若绕过缓存直接修改了这些状态（如新建并绑定 VAO），之后需调用 Invalidate()。
+ */
+struct StateCache {
+    StateCounters frame;        // 本帧计数
+
+    // 帧开始：计数清零
+    void BeginFrame() { frame = StateCounters(); }
+
+    // 影子值作废，之后每项状态的下一次设置都会发出
+    void Invalidate() { known = 0; }
+
+    void Enable(GLenum cap) { SetCapability(cap, true); }
+    void Disable(GLenum cap) { SetCapability(cap, false); }
+
+    void ColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a) {
+        uint8_t mask = (r ? 1 : 0) | (g ? 2 : 0) | (b ? 4 : 0) | (a ? 8 : 0);
+        if (!ShouldIssue(STATE_COLOR_MASK, colorMask == mask)) return;
+        colorMask = mask;
+        glColorMask(r, g, b, a);
+    }
+
+    void DepthMask(GLboolean flag) {
+        if (!ShouldIssue(STATE_DEPTH_MASK, depthMask == flag)) return;
+        depthMask = flag;
+        glDepthMask(flag);
+    }
+
+    void DepthFunc(GLenum func) {
+        if (!ShouldIssue(STATE_DEPTH_FUNC, depthFunc == func)) return;
+        depthFunc = func;
+        glDepthFunc(func);
+    }
+
+    void DepthRange(GLdouble nearVal, GLdouble farVal) {
+        if (!ShouldIssue(STATE_DEPTH_RANGE, depthNear == nearVal && depthFar == farVal)) return;
+        depthNear = nearVal;
+        depthFar = farVal;
+        glDepthRange(nearVal, farVal);
+    }
+
+    void StencilFunc(GLenum func, GLint ref, GLuint mask) {
+        if (!ShouldIssue(STATE_STENCIL_FUNC,
+                         stencilFunc == func && stencilRef == ref && stencilReadMask == mask)) return;
+        stencilFunc = func;
+        stencilRef = ref;
+        stencilReadMask = mask;
+        glStencilFunc(func, ref, mask);
+    }
+
+    void StencilOp(GLenum sfail, GLenum dpfail, GLenum dppass) {
+        if (!ShouldIssue(STATE_STENCIL_OP,
+                         stencilOp[0] == sfail && stencilOp[1] == dpfail && stencilOp[2] == dppass)) return;
+        stencilOp[0] = sfail;
+        stencilOp[1] = dpfail;
+        stencilOp[2] = dppass;
+        glStencilOp(sfail, dpfail, dppass);
+    }
+
+    void StencilMask(GLuint mask) {
+        if (!ShouldIssue(STATE_STENCIL_MASK, stencilWriteMask == mask)) return;
+        stencilWriteMask = mask;
+        glStencilMask(mask);
+    }
+
+    void UseProgram(GLuint program) {
+        if (!ShouldIssue(STATE_PROGRAM, boundProgram == program)) return;
+        boundProgram = program;
+        glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vao) {
+        if (!ShouldIssue(STATE_VERTEX_ARRAY, boundVertexArray == vao)) return;
+        boundVertexArray = vao;
+        glBindVertexArray(vao);
+    }
+
+    void Scissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+        if (!ShouldIssue(STATE_SCISSOR,
+                         scissor[0] == x && scissor[1] == y && scissor[2] == width && scissor[3] == height)) return;
+        scissor[0] = x;
+        scissor[1] = y;
+        scissor[2] = width;
+        scissor[3] = height;
+        glScissor(x, y, width, height);
+    }
+
+private:
+    enum StateBit : uint32_t {
+        STATE_DEPTH_TEST    = 1u << 0,
+        STATE_STENCIL_TEST  = 1u << 1,
+        STATE_CULL_FACE     = 1u << 2,
+        STATE_SCISSOR_TEST  = 1u << 3,
+        STATE_BLEND         = 1u << 4,
+        STATE_COLOR_MASK    = 1u << 5,
+        STATE_DEPTH_MASK    = 1u << 6,
+        STATE_DEPTH_FUNC    = 1u << 7,
+        STATE_DEPTH_RANGE   = 1u << 8,
+        STATE_STENCIL_FUNC  = 1u << 9,
+        STATE_STENCIL_OP    = 1u << 10,
+        STATE_STENCIL_MASK  = 1u << 11,
+        STATE_PROGRAM       = 1u << 12,
+        STATE_VERTEX_ARRAY  = 1u << 13,
+        STATE_SCISSOR       = 1u << 14,
+    };
+
+    // 影子值已知且与新值相同时省略调用，否则记为已知并发出
+    bool ShouldIssue(StateBit bit, bool unchanged) {
+        if (unchanged && (known & bit)) {
+            frame.suppressed++;
+            return false;
+        }
+        known |= bit;
+        frame.issued++;
+        return true;
+    }
+
+    void SetCapability(GLenum cap, bool enabled) {
+        StateBit bit;
+        switch (cap) {
+            case GL_DEPTH_TEST:   bit = STATE_DEPTH_TEST; break;
+            case GL_STENCIL_TEST: bit = STATE_STENCIL_TEST; break;
+            case GL_CULL_FACE:    bit = STATE_CULL_FACE; break;
+            case GL_SCISSOR_TEST: bit = STATE_SCISSOR_TEST; break;
+            case GL_BLEND:        bit = STATE_BLEND; break;
+            default:
+                // 未跟踪的开关直接透传
+                frame.issued++;
+                if (enabled) glEnable(cap); else glDisable(cap);
+                return;
+        }
+        if (!ShouldIssue(bit, ((capabilities & bit) != 0) == enabled)) return;
+        if (enabled) {
+            capabilities |= bit;
+            glEnable(cap);
+        } else {
+            capabilities &= ~(uint32_t)bit;
+            glDisable(cap);
+        }
+    }
+
+    uint32_t known = 0;             // 影子值有效的状态位
+    uint32_t capabilities = 0;      // 已启用的开关（按 StateBit）
+    uint8_t colorMask = 0;
+    GLboolean depthMask = GL_TRUE;
+    GLenum depthFunc = GL_LESS;
+    GLdouble depthNear = 0.0;
+    GLdouble depthFar = 1.0;
+    GLenum stencilFunc = GL_ALWAYS;
+    GLint stencilRef = 0;
+    GLuint stencilReadMask = 0xFF;
+    GLenum stencilOp[3] = { GL_KEEP, GL_KEEP, GL_KEEP };
+    GLuint stencilWriteMask = 0xFF;
+    GLuint boundProgram = 0;
+    GLuint boundVertexArray = 0;
+    GLint scissor[4] = {};
+};
+
+/**
+ * 当前 GL 上下文的状态缓存（本项目只有一个上下文）
+ */
+inline StateCache& GetStateCache() {
+    static StateCache cache;
+    return cache;
+}
+
+} // namespace PortalGL
@@ -0,0 +1,356 @@
+/**
+ * PortalGeometry.h - 索引化、量化的静态网格
+ *
+ * 场景和门户几何体仍由 AddQuad/AddBox 生成非索引三角形列表（每顶点 位置+颜色 6 个 float，
+ * 24 字节），这里把它转换为 GPU 网格：
+ *   - 按物体去重顶点，生成索引缓冲（顶点数不超过 65535 时使用 16 位索引）；
+ *   - 物体内用 Tipsify 重排三角形以提高变换后顶点缓存命中，再按首次使用顺序重排顶点；
+ *   - 位置量化为相对网格包围盒中心的 snorm16，颜色打包为 RGBA8，每顶点 12 字节。
+ *
+ * 反量化（包围盒中心 + 半尺寸）表示为矩阵 StaticMesh::dequantize，
+ * 绘制时乘进 uModel，着色器按原样使用 aPos。
+ */
+
+#pragma once
+
+#include "PortalGL.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+namespace PortalGeometry {
+
+// 源顶点格式：位置 xyz + 颜色 rgb
+constexpr int SOURCE_FLOATS_PER_VERTEX = 6;
+// 重排和统计使用的变换后顶点缓存大小（FIFO）
+constexpr int VERTEX_CACHE_SIZE = 16;
+
+/**
+ * GPU 顶点：snorm16 位置（w 为填充）+ RGBA8 颜色
+ */
+struct PackedVertex {
+    int16_t position[4];
+    uint8_t color[4];
+};
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must be 12 bytes");
+
+/**
+ * 连续区段：输入时为源顶点范围，输出时为索引范围
+ */
+struct MeshRange {
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+/**
+ * 构建前后的内存与顶点读取统计（读取量按一次绘制整个网格计算）
+ */
+struct MeshStats {
+    size_t sourceVertices = 0;      // 非索引顶点数（每个都要读取）
+    size_t uniqueVertices = 0;      // 去重后顶点数
+    size_t indexCount = 0;
+    size_t indexSize = 0;           // 每个索引的字节数
+    size_t fetchedVertices = 0;     // 模拟 FIFO 顶点缓存未命中的次数
+
+    size_t SourceBytes() const { return sourceVertices * SOURCE_FLOATS_PER_VERTEX * sizeof(float); }
+    size_t PackedBytes() const { return uniqueVertices * sizeof(PackedVertex) + indexCount * indexSize; }
+    size_t SourceFetchBytes() const { return SourceBytes(); }
+    size_t PackedFetchBytes() const { return fetchedVertices * sizeof(PackedVertex) + indexCount * indexSize; }
+    // 平均每个三角形的缓存未命中数（非索引时为 3）
+    float ACMR() const { return indexCount ? 3.0f * (float)fetchedVertices / (float)indexCount : 0.0f; }
+};
+
+/**
+ * CPU 端的索引化网格
+ */
+struct IndexedMesh {
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshRange> ranges;  // 每个输入物体在 indices 中的范围
+    glm::mat4 dequantize = glm::mat4(1.0f);
+    MeshStats stats;
+};
+
+// ============================================================================
+//                          顶点缓存优化
+// ============================================================================
+
+/**
+ * Tipsify（Sander, Nehab, Barczak 2007）：按变换后顶点缓存重排三角形
+ * @param indices      局部索引（0..vertexCount-1），原地重排
+ * @param vertexCount  局部顶点数
+ */
+inline void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) return;
+
+    // 顶点 → 三角形邻接表（CSR）
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (uint32_t v : indices) live[v]++;
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + live[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    uint32_t timestamp = VERTEX_CACHE_SIZE + 1;
+    uint32_t cursor = 0;
+    int64_t fanning = 0;
+    while (fanning >= 0) {
+        candidates.clear();
+        uint32_t f = (uint32_t)fanning;
+        for (uint32_t a = offsets[f]; a < offsets[f + 1]; a++) {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (timestamp - cacheTime[v] > (uint32_t)VERTEX_CACHE_SIZE) cacheTime[v] = timestamp++;
+            }
+        }
+
+        // 下一个扇心：候选中仍在缓存里、且处理完所有剩余三角形后不会被挤出的最"老"顶点
+        fanning = -1;
+        uint32_t bestPriority = 0;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            uint32_t age = timestamp - cacheTime[v];
+            uint32_t priority = (age + 2 * live[v] <= (uint32_t)VERTEX_CACHE_SIZE) ? age : 0;
+            if (fanning < 0 || priority > bestPriority) {
+                fanning = v;
+                bestPriority = priority;
+            }
+        }
+        if (fanning >= 0) continue;
+
+        // 死胡同：先找最近用过的顶点，再按顺序扫描剩余顶点
+        while (!deadEnd.empty()) {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0) { fanning = v; break; }
+        }
+        while (fanning < 0 && cursor < vertexCount) {
+            if (live[cursor] > 0) fanning = cursor;
+            cursor++;
+        }
+    }
+    indices.swap(output);
+}
+
+/**
+ * 模拟 FIFO 顶点缓存，返回未命中（需要读取顶点）的次数
+ */
+inline size_t CountVertexFetches(const std::vector<uint32_t>& indices) {
+    std::unordered_map<uint32_t, size_t> insertedAt;
+    size_t misses = 0;
+    for (uint32_t v : indices) {
+        auto it = insertedAt.find(v);
+        if (it != insertedAt.end() && misses - it->second < (size_t)VERTEX_CACHE_SIZE) continue;
+        insertedAt[v] = misses++;
+    }
+    return misses;
+}
+
+// ============================================================================
+//                          网格构建
+// ============================================================================
+
+/**
+ * 从非索引三角形列表构建索引化、量化的网格
+ * @param source   每顶点 6 个 float（位置 + 颜色）
+ * @param objects  源顶点范围（每段为 3 的倍数），各自独立去重和重排；为空时整个数组作为一个物体
+ */
+inline IndexedMesh BuildIndexedMesh(const std::vector<float>& source, const std::vector<MeshRange>& objects = {}) {
+    IndexedMesh mesh;
+    const uint32_t sourceCount = (uint32_t)(source.size() / SOURCE_FLOATS_PER_VERTEX);
+    std::vector<MeshRange> ranges = objects;
+    if (ranges.empty()) {
+        MeshRange all;
+        all.count = sourceCount;
+        ranges.push_back(all);
+    }
+
+    // 量化基准：整个网格的包围盒中心与半尺寸（退化轴取 1，避免除零）
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    for (uint32_t i = 0; i < sourceCount; i++) {
+        glm::vec3 p(source[i * 6], source[i * 6 + 1], source[i * 6 + 2]);
+        boundsMin = i ? glm::min(boundsMin, p) : p;
+        boundsMax = i ? glm::max(boundsMax, p) : p;
+    }
+    glm::vec3 origin = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] < 1e-6f) extent[axis] = 1.0f;
+    }
+    mesh.dequantize = glm::scale(glm::translate(glm::mat4(1.0f), origin), extent);
+
+    auto pack = [&](uint32_t i) {
+        PackedVertex v;
+        for (int axis = 0; axis < 3; axis++) {
+            float n = glm::clamp((source[i * 6 + axis] - origin[axis]) / extent[axis], -1.0f, 1.0f);
+            v.position[axis] = (int16_t)std::lround(n * 32767.0f);
+        }
+        v.position[3] = 0;
+        for (int c = 0; c < 3; c++) {
+            v.color[c] = (uint8_t)std::lround(glm::clamp(source[i * 6 + 3 + c], 0.0f, 1.0f) * 255.0f);
+        }
+        v.color[3] = 255;
+        return v;
+    };
+    struct VertexHash {
+        size_t operator()(const PackedVertex& v) const {
+            uint64_t a, b = 0;
+            std::memcpy(&a, &v, 8);
+            std::memcpy(&b, (const char*)&v + 8, 4);
+            return (size_t)((a ^ (a >> 29)) * 0x9E3779B97F4A7C15ull ^ b);
+        }
+    };
+    struct VertexEqual {
+        bool operator()(const PackedVertex& x, const PackedVertex& y) const {
+            return std::memcmp(&x, &y, sizeof(PackedVertex)) == 0;
+        }
+    };
+
+    std::unordered_map<PackedVertex, uint32_t, VertexHash, VertexEqual> lookup;
+    std::vector<PackedVertex> local;
+    std::vector<uint32_t> localIndices;
+    std::vector<uint32_t> remap;
+    for (const MeshRange& range : ranges) {
+        // 物体内去重
+        lookup.clear();
+        local.clear();
+        localIndices.clear();
+        for (uint32_t i = range.first; i < range.first + range.count; i++) {
+            PackedVertex v = pack(i);
+            auto inserted = lookup.emplace(v, (uint32_t)local.size());
+            if (inserted.second) local.push_back(v);
+            localIndices.push_back(inserted.first->second);
+        }
+
+        OptimizeVertexCache(localIndices, (uint32_t)local.size());
+
+        // 顶点按首次使用顺序存放，顶点读取在内存中大致连续
+        uint32_t base = (uint32_t)mesh.vertices.size();
+        remap.assign(local.size(), UINT32_MAX);
+        MeshRange out;
+        out.first = (uint32_t)mesh.indices.size();
+        out.count = (uint32_t)localIndices.size();
+        for (uint32_t v : localIndices) {
+            if (remap[v] == UINT32_MAX) {
+                remap[v] = (uint32_t)(mesh.vertices.size() - base);
+                mesh.vertices.push_back(local[v]);
+            }
+            mesh.indices.push_back(base + remap[v]);
+        }
+        mesh.ranges.push_back(out);
+    }
+
+    mesh.stats.sourceVertices = sourceCount;
+    mesh.stats.uniqueVertices = mesh.vertices.size();
+    mesh.stats.indexCount = mesh.indices.size();
+    mesh.stats.indexSize = mesh.vertices.size() <= 0xFFFF ? sizeof(uint16_t) : sizeof(uint32_t);
+    mesh.stats.fetchedVertices = CountVertexFetches(mesh.indices);
+    return mesh;
+}
+
+inline void PrintMeshStats(const char* name, const MeshStats& stats) {
+    std::cout << "Mesh '" << name << "': " << stats.sourceVertices << " -> " << stats.uniqueVertices
+              << " vertices + " << stats.indexCount << " indices, memory "
+              << stats.SourceBytes() << " -> " << stats.PackedBytes() << " bytes, fetch per draw "
+              << stats.SourceFetchBytes() << " -> " << stats.PackedFetchBytes() << " bytes (ACMR "
+              << stats.ACMR() << ")" << std::endl;
+}
+
+// ============================================================================
+//                          GPU 网格
+// ============================================================================
+
+/**
+ * 上传后的静态网格
+ */
+struct StaticMesh {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    GLsizei indexSize = sizeof(uint16_t);
+    GLsizei indexCount = 0;
+    glm::mat4 dequantize = glm::mat4(1.0f);     // 乘在模型矩阵右侧
+
+    // 绘制整个网格（程序和 uModel 由调用者设置）
+    void Draw() const {
+        PortalGL::GetStateCache().BindVertexArray(vao);
+        glDrawElements(GL_TRIANGLES, indexCount, indexType, nullptr);
+    }
+
+    // 实例化绘制（逐实例属性须已加到 vao 上）
+    void DrawInstanced(GLsizei instanceCount) const {
+        PortalGL::GetStateCache().BindVertexArray(vao);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, nullptr, instanceCount);
+    }
+};
+
+/**
+ * 上传网格：location 0 = snorm16 位置，location 1 = RGBA8 颜色（均为归一化属性）
+ */
+inline StaticMesh UploadStaticMesh(const IndexedMesh& mesh) {
+    StaticMesh gpu;
+    gpu.indexCount = (GLsizei)mesh.indices.size();
+    gpu.dequantize = mesh.dequantize;
+    gpu.indexSize = (GLsizei)mesh.stats.indexSize;
+    gpu.indexType = gpu.indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    // 经由状态缓存绑定 VAO，上传后保持绑定，缓存不会失效
+    glGenVertexArrays(1, &gpu.vao);
+    glGenBuffers(1, &gpu.vbo);
+    glGenBuffers(1, &gpu.ebo);
+    PortalGL::GetStateCache().BindVertexArray(gpu.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(PackedVertex), mesh.vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, color));
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.ebo);
+    if (gpu.indexType == GL_UNSIGNED_SHORT) {
+        std::vector<uint16_t> narrow(mesh.indices.begin(), mesh.indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, narrow.size() * sizeof(uint16_t), narrow.data(), GL_STATIC_DRAW);
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(), GL_STATIC_DRAW);
+    }
+    return gpu;
+}
+
+inline void DestroyStaticMesh(StaticMesh& mesh) {
+    if (mesh.vao) glDeleteVertexArrays(1, &mesh.vao);
+    if (mesh.vbo) glDeleteBuffers(1, &mesh.vbo);
+    if (mesh.ebo) glDeleteBuffers(1, &mesh.ebo);
+    mesh = StaticMesh();
+}
+
+} // namespace PortalGeometry
@@ -0,0 +1,337 @@
+/**
+ * PortalHeadless.h - 无窗口离屏运行（基准测试/CI）
+ *
+ * 没有显示器和 GPU 的机器上用 EGL 创建无表面的 OpenGL 3.3 core 上下文
+ * （Mesa 的 surfaceless 平台 + llvmpipe 软件光栅化），渲染到固定尺寸的 FBO。
+ * 相机沿脚本路径移动，逐帧记录 CPU/GPU 耗时，可选把帧保存为 PNG。
+ *
+ * 只在 PORTAL_ENABLE_HEADLESS 构建中使用（链接 EGL）。
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace PortalHeadless {
+
+// ============================================================================
+//                          EGL 上下文
+// ============================================================================
+
+struct Context {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+
+/**
+ * 创建并激活无表面上下文
+ * 优先 EGL_MESA_platform_surfaceless（不需要 X/Wayland 或 DRM 设备），否则退回默认显示
+ * @return 失败时返回 false（原因输出到 std::cerr）
+ */
+inline bool CreateContext(Context& ctx) {
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        ctx.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (ctx.display == EGL_NO_DISPLAY) {
+        ctx.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major = 0, minor = 0;
+    if (ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, &major, &minor)) {
+        std::cerr << "EGL initialization failed" << std::endl;
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL: desktop OpenGL API not available" << std::endl;
+        return false;
+    }
+
+    // 颜色/深度/模板都在 FBO 中，配置只需支持 OpenGL
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(ctx.display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        std::cerr << "EGL: no OpenGL config" << std::endl;
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    ctx.context = eglCreateContext(ctx.display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (ctx.context == EGL_NO_CONTEXT) {
+        std::cerr << "EGL: failed to create an OpenGL 3.3 core context" << std::endl;
+        return false;
+    }
+    // 需要 EGL_KHR_surfaceless_context（Mesa 均支持）
+    if (!eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.context)) {
+        std::cerr << "EGL: surfaceless make-current failed" << std::endl;
+        return false;
+    }
+
+    std::cout << "EGL " << major << "." << minor << ", renderer: "
+              << (const char*)glGetString(GL_RENDERER) << std::endl;
+    return true;
+}
+
+inline void DestroyContext(Context& ctx) {
+    if (ctx.display == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (ctx.context != EGL_NO_CONTEXT) eglDestroyContext(ctx.display, ctx.context);
+    eglTerminate(ctx.display);
+    ctx = Context();
+}
+
+// ============================================================================
+//                          离屏后台缓冲
+// ============================================================================
+
+/**
+ * 代替窗口默认帧缓冲：RGBA8 颜色 + 24 位深度/8 位模板
+ */
+struct Backbuffer {
+    GLuint fbo = 0;
+    GLuint color = 0;
+    GLuint depthStencil = 0;
+    int width = 0;
+    int height = 0;
+
+    bool Create(int w, int h) {
+        width = w;
+        height = h;
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &color);
+        glGenRenderbuffers(1, &depthStencil);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Headless backbuffer is incomplete" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    void Destroy() {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        if (color) glDeleteRenderbuffers(1, &color);
+        if (depthStencil) glDeleteRenderbuffers(1, &depthStencil);
+        *this = Backbuffer();
+    }
+
+    // 读回颜色（行序自下而上，与 GL 一致）
+    void ReadPixels(std::vector<uint8_t>& rgba) const {
+        rgba.resize((size_t)width * height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    }
+};
+
+// ============================================================================
+//                          脚本相机路径
+// ============================================================================
+
+struct CameraKey {
+    glm::vec3 position;
+    float yaw;          // 度，与 g_CameraYaw 约定相同
+    float pitch;
+};
+
+/**
+ * 循环的关键帧路径，关键帧之间等时长线性插值
+ */
+struct CameraPath {
+    std::vector<CameraKey> keys;
+    float segmentDuration = 2.0f;   // 秒
+
+    CameraKey Sample(float time) const {
+        if (keys.size() < 2) return keys.empty() ? CameraKey{ glm::vec3(0.0f), 0.0f, 0.0f } : keys[0];
+        float loop = segmentDuration * (float)keys.size();
+        float t = std::fmod(time, loop) / segmentDuration;
+        size_t i = (size_t)t;
+        float f = t - (float)i;
+        const CameraKey& a = keys[i % keys.size()];
+        const CameraKey& b = keys[(i + 1) % keys.size()];
+        return { glm::mix(a.position, b.position, f), glm::mix(a.yaw, b.yaw, f), glm::mix(a.pitch, b.pitch, f) };
+    }
+};
+
+// ============================================================================
+//                          PNG 输出
+// ============================================================================
+
+inline uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/**
+ * 写 8 位 RGBA PNG。zlib 流只用不压缩的 stored 块，不依赖外部库（文件较大，仅用于核对画面）
+ * @param bottomUp 行序为自下而上（glReadPixels 的结果）
+ */
+inline bool WritePNG(const std::string& path, int width, int height, const std::vector<uint8_t>& rgba, bool bottomUp) {
+    // 每行前加过滤类型 0
+    size_t rowBytes = (size_t)width * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; y++) {
+        int src = bottomUp ? height - 1 - y : y;
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba.begin() + src * rowBytes, rgba.begin() + (src + 1) * rowBytes);
+    }
+
+    // zlib：头 + stored 块（每块最多 65535 字节）+ Adler-32
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+    for (size_t offset = 0; ; ) {
+        size_t len = std::min<size_t>(65535, raw.size() - offset);
+        bool last = offset + len == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((uint8_t)(len & 0xFF));
+        zlib.push_back((uint8_t)(len >> 8));
+        zlib.push_back((uint8_t)(~len & 0xFF));
+        zlib.push_back((uint8_t)((~len >> 8) & 0xFF));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + len);
+        for (size_t i = offset; i < offset + len; i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        offset += len;
+        if (last) break;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8) zlib.push_back((uint8_t)(adler >> shift));
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return false;
+    }
+    auto writeChunk = [file](const char* type, const uint8_t* data, size_t size) {
+        uint8_t header[8] = {
+            (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size,
+            (uint8_t)type[0], (uint8_t)type[1], (uint8_t)type[2], (uint8_t)type[3]
+        };
+        uint32_t crc = Crc32(header + 4, 4);
+        crc = Crc32(data, size, crc);
+        uint8_t footer[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+        fwrite(header, 1, 8, file);
+        if (size) fwrite(data, 1, size, file);
+        fwrite(footer, 1, 4, file);
+    };
+
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, file);
+    uint8_t ihdr[13] = {
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 6, 0, 0, 0   // 8 位、RGBA、deflate、自适应过滤、不隔行
+    };
+    writeChunk("IHDR", ihdr, sizeof(ihdr));
+    writeChunk("IDAT", zlib.data(), zlib.size());
+    writeChunk("IEND", nullptr, 0);
+    fclose(file);
+    return true;
+}
+
+// ============================================================================
+//                          运行参数与计时汇总
+// ============================================================================
+
+struct Options {
+    int frames = 300;
+    float frameStep = 1.0f / 60.0f;     // 每帧推进的模拟时间（秒），与实际耗时无关，结果可复现
+    std::string csvPath;                // 逐帧计时 CSV（为空则不写）
+    std::string captureDir = ".";
+    int captureEvery = 0;               // 每 N 帧保存一张 PNG（0 = 不保存）
+    std::string tracePath;              // CPU 区段和 GPU 计时导出为 Chrome trace（为空则不写）
+};
+
+/**
+ * 解析 --headless 之后的参数：--frames N --step S --csv PATH --capture-every N --capture-dir DIR --trace PATH
+ * @return 出现未知参数时返回 false
+ */
+inline bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless") continue;
+        if (arg == "--frames" && hasValue) options.frames = std::max(1, atoi(argv[++i]));
+        else if (arg == "--step" && hasValue) options.frameStep = (float)atof(argv[++i]);
+        else if (arg == "--csv" && hasValue) options.csvPath = argv[++i];
+        else if (arg == "--capture-every" && hasValue) options.captureEvery = std::max(0, atoi(argv[++i]));
+        else if (arg == "--capture-dir" && hasValue) options.captureDir = argv[++i];
+        else if (arg == "--trace" && hasValue) options.tracePath = argv[++i];
+        else if ((arg == "--log" || arg == "--log-file") && hasValue) i++;  // 已由 main 交给 PortalLog
+        else {
+            std::cerr << "Unknown headless option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool HasFlag(int argc, char** argv, const char* flag) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], flag) == 0) return true;
+    }
+    return false;
+}
+
+// 输出 min/mean/p50/p95/p99/max（毫秒）
+inline void PrintTimingSummary(const char* label, std::vector<double> samples) {
+    if (samples.empty()) return;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double s : samples) sum += s;
+    auto percentile = [&samples](double p) {
+        size_t index = (size_t)(p * (double)(samples.size() - 1) + 0.5);
+        return samples[index];
+    };
+    printf("  %-4s min %8.3f  mean %8.3f  p50 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f ms\n",
+           label, samples.front(), sum / (double)samples.size(),
+           percentile(0.50), percentile(0.95), percentile(0.99), samples.back());
+}
+
+} // namespace PortalHeadless
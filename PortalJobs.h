@@ -0,0 +1,116 @@
+/**
+ * PortalJobs.h - 固定工作线程池上的并行循环
+ *
+ * ParallelFor(count, job) 把 [0, count) 分给工作线程和调用线程，全部完成后返回。
+ * job 收到任务下标和执行者下标（调用线程为 0，工作线程为 1..N），
+ * 调用方按执行者下标准备线程私有的临时内存，任务之间无需加锁。
+ * 下标通过原子计数逐个领取，任务大小不均时自动均衡。
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PortalJobs {
+
+// 默认的工作线程数：留出主线程和模拟线程
+inline int DefaultWorkerCount() {
+    int hardware = (int)std::thread::hardware_concurrency();
+    return std::max(0, std::min(hardware - 2, 7));
+}
+
+struct JobPool {
+    typedef std::function<void(int index, int worker)> Job;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;       // 新一批任务或停止
+    std::condition_variable done;       // 工作线程离开一批任务
+
+    // 当前一批任务（在 mutex 下发布）
+    const Job* job = nullptr;
+    int jobCount = 0;
+    uint64_t generation = 0;
+    int active = 0;                     // 正在处理当前批次的工作线程数
+    bool stopping = false;
+    std::atomic<int> next{ 0 };         // 下一个待领取的任务下标
+
+    // 执行者数量（含调用线程），线程私有数据按此分配
+    int ExecutorCount() const { return (int)threads.size() + 1; }
+
+    void Start(int workerCount) {
+        Stop();
+        stopping = false;
+        for (int i = 0; i < workerCount; i++) {
+            threads.emplace_back([this, i]() { WorkerLoop(i + 1); });
+        }
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+        threads.clear();
+    }
+
+    ~JobPool() { Stop(); }
+
+    void ParallelFor(int count, const Job& fn) {
+        if (count <= 0) return;
+        if (threads.empty() || count == 1) {
+            for (int i = 0; i < count; i++) fn(i, 0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            next.store(0, std::memory_order_relaxed);
+            generation++;
+        }
+        wake.notify_all();
+        RunJobs(fn, count, 0);
+
+        // 等所有工作线程离开这一批，之后才能复用 next
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return active == 0; });
+        job = nullptr;
+        jobCount = 0;
+    }
+
+private:
+    void RunJobs(const Job& fn, int count, int worker) {
+        for (int i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+             i = next.fetch_add(1, std::memory_order_relaxed)) {
+            fn(i, worker);
+        }
+    }
+
+    void WorkerLoop(int worker) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&]() { return stopping || (job != nullptr && generation != seen); });
+            if (stopping) return;
+            seen = generation;
+            const Job* fn = job;
+            int count = jobCount;
+            active++;
+            lock.unlock();
+            RunJobs(*fn, count, worker);
+            lock.lock();
+            if (--active == 0) done.notify_one();
+        }
+    }
+};
+
+} // namespace PortalJobs
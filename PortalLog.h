@@ -0,0 +1,318 @@
+/**
+ * PortalLog.h - 异步日志
+ *
+ * 渲染线程上的日志只做一次分类/级别检查和一次 snprintf：格式化结果写入该线程私有的
+ * 单生产者单消费者环（无锁，满时丢弃并计数，从不阻塞），后台线程定期取出、按时间合并后
+ * 写到 stdout 或文件。被关闭的日志点只有一次 relaxed 原子读和比较。
+ *
+ * 用法：
+ *   PortalLog::Start(nullptr);                    // stdout；或传入文件路径
+ *   PORTAL_LOG(Portal, Debug, "view L%d", depth); // 分类和级别不写前缀
+ *   PortalLog::Shutdown();                        // 写出剩余记录并结束后台线程
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace PortalLog {
+
+// ============================================================================
+//                          分类与级别
+// ============================================================================
+
+enum class Category : uint8_t {
+    General,    // 启动、模式切换、文件输出
+    Frame,      // 每两秒一次的帧统计
+    Portal,     // 门户视图遍历细节
+    Teleport,   // 玩家/实体穿越门户
+    Count
+};
+
+enum class Level : uint8_t {
+    Error,
+    Warn,
+    Info,
+    Debug
+};
+
+inline const char* GetCategoryName(Category category) {
+    switch (category) {
+        case Category::General:  return "general";
+        case Category::Frame:    return "frame";
+        case Category::Portal:   return "portal";
+        case Category::Teleport: return "teleport";
+        default:                 return "?";
+    }
+}
+
+inline const char* GetLevelName(Level level) {
+    switch (level) {
+        case Level::Error: return "error";
+        case Level::Warn:  return "warn";
+        case Level::Info:  return "info";
+        case Level::Debug: return "debug";
+    }
+    return "?";
+}
+
+// 每个分类输出的最高级别（默认 Info）
+inline std::atomic<uint8_t>* GetLevels() {
+    static std::atomic<uint8_t> levels[(size_t)Category::Count] = {
+        { (uint8_t)Level::Info }, { (uint8_t)Level::Info }, { (uint8_t)Level::Info }, { (uint8_t)Level::Info }
+    };
+    return levels;
+}
+
+inline bool Enabled(Category category, Level level) {
+    return (uint8_t)level <= GetLevels()[(size_t)category].load(std::memory_order_relaxed);
+}
+
+inline void SetLevel(Category category, Level level) {
+    GetLevels()[(size_t)category].store((uint8_t)level, std::memory_order_relaxed);
+}
+
+/**
+ * 解析级别配置："debug"（全部分类）或 "portal=debug,frame=warn"
+ * @return 出现未知的分类或级别时返回 false（之前的项仍然生效）
+ */
+inline bool ParseLevels(const std::string& spec) {
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        size_t equals = item.find('=');
+        std::string categoryName = equals == std::string::npos ? "" : item.substr(0, equals);
+        std::string levelName = equals == std::string::npos ? item : item.substr(equals + 1);
+
+        int level = -1;
+        for (int l = 0; l <= (int)Level::Debug; l++) {
+            if (levelName == GetLevelName((Level)l)) level = l;
+        }
+        if (level < 0) return false;
+
+        bool matched = false;
+        for (size_t c = 0; c < (size_t)Category::Count; c++) {
+            if (categoryName.empty() || categoryName == GetCategoryName((Category)c)) {
+                SetLevel((Category)c, (Level)level);
+                matched = true;
+            }
+        }
+        if (!matched) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+// ============================================================================
+//                          线程私有的记录环
+// ============================================================================
+
+// 单条记录的文本长度上限，超出部分被截断
+constexpr size_t LOG_TEXT_LENGTH = 240;
+// 每个线程环的记录数（2 的幂）
+constexpr size_t LOG_RING_SIZE = 1024;
+// 后台线程两次取出之间的最长间隔
+constexpr int LOG_DRAIN_INTERVAL_MS = 10;
+
+struct Record {
+    uint64_t timeNs;
+    Category category;
+    Level level;
+    char text[LOG_TEXT_LENGTH];
+};
+
+/**
+ * 单生产者（所属线程）单消费者（后台线程）环
+ * head 只由生产者写、tail 只由消费者写，分处不同缓存行
+ */
+struct Ring {
+    std::unique_ptr<Record[]> records{ new Record[LOG_RING_SIZE] };
+    alignas(64) std::atomic<uint64_t> head{ 0 };
+    alignas(64) std::atomic<uint64_t> tail{ 0 };
+    alignas(64) std::atomic<uint64_t> dropped{ 0 };
+
+    // 生产者：占一个槽位，环满时返回 nullptr
+    Record* Reserve() {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &records[h & (LOG_RING_SIZE - 1)];
+    }
+
+    void Commit() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+// ============================================================================
+//                          后台输出
+// ============================================================================
+
+struct Logger {
+    std::mutex mutex;                       // 保护 rings 注册和输出（消费者侧）
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<Record> pending;            // 本次取出的记录，按时间排序后输出
+    FILE* output = stdout;
+    uint64_t startNs = NowNs();             // 输出中的时间相对首次使用日志
+    uint64_t droppedReported = 0;
+
+    std::thread thread;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool running = false;
+
+    ~Logger() { Stop(); }
+
+    static uint64_t NowNs() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Ring& ThreadRing() {
+        thread_local Ring* ring = nullptr;
+        if (!ring) {
+            std::lock_guard<std::mutex> lock(mutex);
+            rings.emplace_back(new Ring());
+            ring = rings.back().get();
+        }
+        return *ring;
+    }
+
+    // 取出所有环中已提交的记录并写出（任意线程可调用，消费者之间互斥）
+    void Drain() {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+        uint64_t dropped = 0;
+        for (const std::unique_ptr<Ring>& ring : rings) {
+            uint64_t t = ring->tail.load(std::memory_order_relaxed);
+            uint64_t h = ring->head.load(std::memory_order_acquire);
+            for (; t < h; t++) {
+                pending.push_back(ring->records[t & (LOG_RING_SIZE - 1)]);
+            }
+            ring->tail.store(t, std::memory_order_release);
+            dropped += ring->dropped.load(std::memory_order_relaxed);
+        }
+        if (pending.empty() && dropped == droppedReported) return;
+
+        std::stable_sort(pending.begin(), pending.end(),
+                         [](const Record& a, const Record& b) { return a.timeNs < b.timeNs; });
+        for (const Record& record : pending) {
+            double seconds = (double)(int64_t)(record.timeNs - startNs) / 1.0e9;
+            if (record.level <= Level::Warn) {
+                fprintf(output, "[%9.3f] [%s] %s: %s\n", seconds, GetCategoryName(record.category),
+                        GetLevelName(record.level), record.text);
+            } else {
+                fprintf(output, "[%9.3f] [%s] %s\n", seconds, GetCategoryName(record.category), record.text);
+            }
+        }
+        if (dropped != droppedReported) {
+            fprintf(output, "[log] %llu records dropped (ring full)\n", (unsigned long long)(dropped - droppedReported));
+            droppedReported = dropped;
+        }
+        fflush(output);
+    }
+
+    // 结束后台线程，写出剩余记录并关闭输出文件
+    void Stop() {
+        if (running) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                running = false;
+            }
+            wake.notify_one();
+            thread.join();
+        }
+        Drain();
+        if (output != stdout) {
+            fclose(output);
+            output = stdout;
+        }
+    }
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (running) {
+            wake.wait_for(lock, std::chrono::milliseconds(LOG_DRAIN_INTERVAL_MS));
+            lock.unlock();
+            Drain();
+            lock.lock();
+        }
+    }
+};
+
+inline Logger& GetLogger() {
+    static Logger logger;
+    return logger;
+}
+
+/**
+ * 启动后台线程
+ * @param path 输出文件路径，nullptr 时写 stdout
+ * @return 无法打开文件时返回 false（仍写 stdout）
+ */
+inline bool Start(const char* path) {
+    Logger& logger = GetLogger();
+    if (logger.running) return true;
+    bool opened = true;
+    if (path) {
+        FILE* file = fopen(path, "w");
+        if (file) logger.output = file;
+        else opened = false;
+    }
+    logger.running = true;
+    logger.thread = std::thread([&logger]() { logger.Run(); });
+    return opened;
+}
+
+// 立即写出已提交的记录（在调用线程上执行，用于直接写 stdout 之前保持顺序）
+inline void Flush() {
+    GetLogger().Drain();
+}
+
+inline void Shutdown() {
+    GetLogger().Stop();
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((format(printf, 3, 4)))
+#endif
+inline void Write(Category category, Level level, const char* format, ...) {
+    Logger& logger = GetLogger();
+    Ring& ring = logger.ThreadRing();
+    Record* record = ring.Reserve();
+    if (!record) return;
+    record->timeNs = Logger::NowNs();
+    record->category = category;
+    record->level = level;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(record->text, LOG_TEXT_LENGTH, format, args);
+    va_end(args);
+    ring.Commit();
+}
+
+} // namespace PortalLog
+
+// 关闭的日志点只检查级别，不求值参数
+#define PORTAL_LOG(category, level, ...)                                                            \
+    do {                                                                                            \
+        if (PortalLog::Enabled(PortalLog::Category::category, PortalLog::Level::level)) {          \
+            PortalLog::Write(PortalLog::Category::category, PortalLog::Level::level, __VA_ARGS__);  \
+        }                                                                                           \
+    } while (0)
@@ -15,6 +15,10 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 namespace PortalMath {
 
@@ -198,4 +202,344 @@ inline glm::mat4 CalculateObliqueProjection(
     return CalculateObliqueProjectionMatrix(projectionMatrix, viewSpacePlane);
 }
 
+// ============================================================================
+//                      刚体变换 (RigidTransform)
+// ============================================================================
+
+/**
+ * RigidTransform - 旋转（四元数）+ 平移
+ *
+ * 门户和相机变换始终是刚体变换。用 mat4 表示时每次组合需要 64 次乘法，
+ * 求逆要走通用的 glm::inverse；四元数形式组合更便宜，求逆只需共轭。
+ * 只在上传给 GL 时才通过 ToMatrix() 转为 mat4。
+ */
+struct RigidTransform {
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 translation = glm::vec3(0.0f);
+
+    RigidTransform() = default;
+    RigidTransform(const glm::quat& r, const glm::vec3& t) : rotation(r), translation(t) {}
+
+    // 从刚体矩阵构造（要求左上3x3为正交旋转，无缩放）
+    static RigidTransform FromMatrix(const glm::mat4& m) {
+        return RigidTransform(glm::normalize(glm::quat_cast(glm::mat3(m))), glm::vec3(m[3]));
+    }
+
+    glm::mat4 ToMatrix() const {
+        glm::mat4 m = glm::mat4_cast(rotation);
+        m[3] = glm::vec4(translation, 1.0f);
+        return m;
+    }
+
+    glm::vec3 TransformPoint(const glm::vec3& p) const {
+        return rotation * p + translation;
+    }
+
+    glm::vec3 TransformDirection(const glm::vec3& d) const {
+        return rotation * d;
+    }
+};
+
+inline RigidTransform operator*(const RigidTransform& a, const RigidTransform& b) {
+    return RigidTransform(a.rotation * b.rotation, a.rotation * b.translation + a.translation);
+}
+
+inline RigidTransform Inverse(const RigidTransform& t) {
+    glm::quat inv = glm::conjugate(t.rotation);
+    return RigidTransform(inv, -(inv * t.translation));
+}
+
+/**
+ * 绕Y轴180度旋转的刚体变换
+ */
+inline RigidTransform GetRigidRotate180() {
+    return RigidTransform(glm::quat(0.0f, 0.0f, 1.0f, 0.0f), glm::vec3(0.0f));
+}
+
+/**
+ * 视图变换对应的相机世界位置 / 前向
+ */
+inline glm::vec3 GetCameraPosition(const RigidTransform& view) {
+    return Inverse(view).translation;
+}
+
+inline glm::vec3 GetCameraForward(const RigidTransform& view) {
+    return glm::conjugate(view.rotation) * glm::vec3(0.0f, 0.0f, -1.0f);
+}
+
+/**
+ * 把世界空间平面变换到刚体变换（如视图变换）的目标空间
+ * 等价于 transpose(inverse(M)) × plane，但无需求逆
+ */
+inline glm::vec4 TransformPlane(const glm::vec4& worldPlane, const RigidTransform& t) {
+    glm::vec3 n = t.rotation * glm::vec3(worldPlane);
+    return glm::vec4(n, worldPlane.w - glm::dot(n, t.translation));
+}
+
+/**
+ * 同上，但输入为刚体矩阵（如 lookAt 得到的视图矩阵）
+ */
+inline glm::vec4 TransformPlaneRigid(const glm::vec4& worldPlane, const glm::mat4& rigidMatrix) {
+    glm::vec3 n = glm::mat3(rigidMatrix) * glm::vec3(worldPlane);
+    return glm::vec4(n, worldPlane.w - glm::dot(n, glm::vec3(rigidMatrix[3])));
+}
+
+/**
+ * ComputePortalTransform（刚体版本）
+ * Target × Rotate180 × Inverse(Source)
+ */
+inline RigidTransform ComputePortalTransform(
+    const RigidTransform& sourcePortal,
+    const RigidTransform& targetPortal)
+{
+    return targetPortal * GetRigidRotate180() * Inverse(sourcePortal);
+}
+
+/**
+ * 传送位置/方向/变换（刚体版本）
+ */
+inline glm::vec3 TeleportPosition(
+    const glm::vec3& worldPosition,
+    const RigidTransform& sourcePortal,
+    const RigidTransform& targetPortal)
+{
+    return ComputePortalTransform(sourcePortal, targetPortal).TransformPoint(worldPosition);
+}
+
+inline glm::vec3 TeleportDirection(
+    const glm::vec3& worldDirection,
+    const RigidTransform& sourcePortal,
+    const RigidTransform& targetPortal)
+{
+    return glm::normalize(ComputePortalTransform(sourcePortal, targetPortal).TransformDirection(worldDirection));
+}
+
+inline RigidTransform TeleportTransform(
+    const RigidTransform& worldTransform,
+    const RigidTransform& sourcePortal,
+    const RigidTransform& targetPortal)
+{
+    return ComputePortalTransform(sourcePortal, targetPortal) * worldTransform;
+}
+
+/**
+ * 计算Portal视图（刚体版本）
+ * Inverse(portalTransform × Inverse(PlayerView)) = PlayerView × Source × Rotate180 × Inverse(Target)
+ */
+inline RigidTransform CalculatePortalViewMatrix(
+    const RigidTransform& playerView,
+    const RigidTransform& sourcePortal,
+    const RigidTransform& targetPortal)
+{
+    return playerView * sourcePortal * GetRigidRotate180() * Inverse(targetPortal);
+}
+
+// ============================================================================
+//                      门户对缓存变换 (PortalLink)
+// ============================================================================
+
+/**
+ * 右乘绕Y轴180度旋转（精确版本）
+ * 等价于 m × rotate(π, Y)，但直接对 X/Z 列取反，避免三角函数和浮点误差
+ */
+inline glm::mat4 ApplyRotate180(const glm::mat4& m)
+{
+    return glm::mat4(-m[0], m[1], -m[2], m[3]);
+}
+
+/**
+ * PortalLink - 一对链接门户的预计算数据
+ *
+ * 门户矩阵很少变化，但传送检测和递归渲染每帧都会对每个实体、每个门户、
+ * 每个递归层级重复构造 rotate180 并求 inverse(sourcePortal)。
+ * PortalLink 只在门户变换改变时重建一次（由 Portal 的代数计数器驱动）。
+ */
+struct PortalLink {
+    glm::mat4 forward;          // 入口 -> 出口: Target × Rotate180 × Inverse(Source)
+    glm::mat4 inverse;          // 出口 -> 入口: Inverse(forward)
+    glm::mat4 sourceInverse;    // 入口门户局部空间（世界 -> 门户局部）
+    glm::vec4 sourcePlane;      // 入口门户世界平面，同 GetPortalPlane
+    glm::vec4 targetPlane;      // 出口门户世界平面
+    glm::vec3 sourcePosition;
+    glm::vec3 sourceForward;    // 入口门户正面法线（+Z，已归一化）
+    glm::vec3 targetPosition;
+    glm::vec3 targetForward;    // 出口门户正面法线（+Z，已归一化）
+    RigidTransform rigidForward;    // forward 的刚体形式
+    RigidTransform rigidInverse;    // inverse 的刚体形式
+
+    // 构建时入口/出口门户的变换代数，用于判断缓存是否失效
+    uint32_t sourceGeneration = 0;
+    uint32_t targetGeneration = 0;
+};
+
+/**
+ * 从入口/出口门户矩阵构建 PortalLink
+ */
+inline PortalLink BuildPortalLink(
+    const glm::mat4& sourcePortalMatrix,
+    const glm::mat4& targetPortalMatrix)
+{
+    PortalLink link;
+    link.sourceInverse = glm::inverse(sourcePortalMatrix);
+    link.forward = ApplyRotate180(targetPortalMatrix) * link.sourceInverse;
+    link.inverse = ApplyRotate180(sourcePortalMatrix) * glm::inverse(targetPortalMatrix);
+    link.sourcePlane = GetPortalPlane(sourcePortalMatrix);
+    link.targetPlane = GetPortalPlane(targetPortalMatrix);
+    link.sourcePosition = glm::vec3(sourcePortalMatrix[3]);
+    link.sourceForward = GetPortalForward(sourcePortalMatrix);
+    link.targetPosition = glm::vec3(targetPortalMatrix[3]);
+    link.targetForward = GetPortalForward(targetPortalMatrix);
+    link.rigidForward = ComputePortalTransform(
+        RigidTransform::FromMatrix(sourcePortalMatrix), RigidTransform::FromMatrix(targetPortalMatrix));
+    link.rigidInverse = Inverse(link.rigidForward);
+    return link;
+}
+
+/**
+ * 点到平面的有符号距离（平面取自 GetPortalPlane / PortalLink）
+ * 与 GetSignedDistanceToPortal 结果一致
+ */
+inline float GetSignedDistanceToPlane(const glm::vec3& point, const glm::vec4& plane)
+{
+    return glm::dot(glm::vec3(plane), point) + plane.w;
+}
+
+/**
+ * 传送位置（使用缓存的门户对变换）
+ */
+inline glm::vec3 TeleportPosition(const glm::vec3& worldPosition, const PortalLink& link)
+{
+    return glm::vec3(link.forward * glm::vec4(worldPosition, 1.0f));
+}
+
+/**
+ * 传送方向向量（使用缓存的门户对变换）
+ */
+inline glm::vec3 TeleportDirection(const glm::vec3& worldDirection, const PortalLink& link)
+{
+    return glm::normalize(glm::vec3(link.forward * glm::vec4(worldDirection, 0.0f)));
+}
+
+/**
+ * 传送完整变换矩阵（使用缓存的门户对变换）
+ */
+inline glm::mat4 TeleportMatrix(const glm::mat4& worldMatrix, const PortalLink& link)
+{
+    return link.forward * worldMatrix;
+}
+
+/**
+ * 计算Portal视图矩阵（使用缓存的门户对变换）
+ *
+ * Inverse(forward × Inverse(PlayerView)) = PlayerView × Inverse(forward)，
+ * 因此无需任何矩阵求逆。
+ */
+inline glm::mat4 CalculatePortalViewMatrix(const glm::mat4& playerViewMatrix, const PortalLink& link)
+{
+    return playerViewMatrix * link.inverse;
+}
+
+inline RigidTransform CalculatePortalViewMatrix(const RigidTransform& playerView, const PortalLink& link)
+{
+    return playerView * link.rigidInverse;
+}
+
+// ============================================================================
+//                      屏幕空间裁剪矩形 (Scissor)
+// ============================================================================
+
+/**
+ * 屏幕空间矩形（像素，原点在左下角，与 glScissor 一致）
+ */
+struct ScreenRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool IsEmpty() const { return width <= 0 || height <= 0; }
+};
+
+inline ScreenRect IntersectScreenRects(const ScreenRect& a, const ScreenRect& b)
+{
+    ScreenRect r;
+    r.x = std::max(a.x, b.x);
+    r.y = std::max(a.y, b.y);
+    r.width = std::min(a.x + a.width, b.x + b.width) - r.x;
+    r.height = std::min(a.y + a.height, b.y + b.height) - r.y;
+    if (r.IsEmpty()) {
+        r.width = 0;
+        r.height = 0;
+    }
+    return r;
+}
+
+/**
+ * 计算门户四边形在屏幕上的包围矩形
+ *
+ * 门户四边形位于局部 z=0 平面，范围 [-halfWidth, halfWidth] × [-halfHeight, halfHeight]。
+ * 先在裁剪空间中对近平面 (z >= -w) 做 Sutherland-Hodgman 裁剪，
+ * 避免相机附近或身后的顶点投影后翻转；完全在近平面后方时返回空矩形。
+ *
+ * @param portalMVP  projection × view × portalTransform
+ */
+inline ScreenRect ComputePortalScreenRect(
+    const glm::mat4& portalMVP,
+    float halfWidth,
+    float halfHeight,
+    int viewportWidth,
+    int viewportHeight)
+{
+    glm::vec4 corners[4] = {
+        portalMVP * glm::vec4(-halfWidth, -halfHeight, 0.0f, 1.0f),
+        portalMVP * glm::vec4( halfWidth, -halfHeight, 0.0f, 1.0f),
+        portalMVP * glm::vec4( halfWidth,  halfHeight, 0.0f, 1.0f),
+        portalMVP * glm::vec4(-halfWidth,  halfHeight, 0.0f, 1.0f)
+    };
+
+    // 依次裁剪：近平面 (z + w >= 0)，以及 w > 0
+    // 斜裁剪投影的"近平面"是倾斜的，仅靠第一个平面无法排除相机身后的点
+    // 每个平面最多增加一个顶点：4 -> 5 -> 6
+    auto clipPolygon = [](const glm::vec4* in, int inCount, glm::vec4* out, const glm::vec4& plane) {
+        int outCount = 0;
+        for (int i = 0; i < inCount; i++) {
+            const glm::vec4& a = in[i];
+            const glm::vec4& b = in[(i + 1) % inCount];
+            float da = glm::dot(plane, a);
+            float db = glm::dot(plane, b);
+            if (da >= 0.0f) out[outCount++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                out[outCount++] = glm::mix(a, b, da / (da - db));
+            }
+        }
+        return outCount;
+    };
+    glm::vec4 nearClipped[5];
+    int nearCount = clipPolygon(corners, 4, nearClipped, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+    if (nearCount == 0) return ScreenRect();
+    glm::vec4 clipped[6];
+    int clippedCount = clipPolygon(nearClipped, nearCount, clipped, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    if (clippedCount == 0) return ScreenRect();
+
+    float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+    for (int i = 0; i < clippedCount; i++) {
+        float w = std::max(clipped[i].w, 1e-6f);
+        float ndcX = glm::clamp(clipped[i].x / w, -1.0f, 1.0f);
+        float ndcY = glm::clamp(clipped[i].y / w, -1.0f, 1.0f);
+        minX = std::min(minX, ndcX);
+        minY = std::min(minY, ndcY);
+        maxX = std::max(maxX, ndcX);
+        maxY = std::max(maxY, ndcY);
+    }
+    if (minX >= maxX || minY >= maxY) return ScreenRect();
+
+    // NDC -> 像素，向外取整保证覆盖所有被光栅化的像素
+    ScreenRect r;
+    r.x = (int)std::floor((minX * 0.5f + 0.5f) * viewportWidth);
+    r.y = (int)std::floor((minY * 0.5f + 0.5f) * viewportHeight);
+    r.width = (int)std::ceil((maxX * 0.5f + 0.5f) * viewportWidth) - r.x;
+    r.height = (int)std::ceil((maxY * 0.5f + 0.5f) * viewportHeight) - r.y;
+    return r;
+}
+
 } // namespace PortalMath
@@ -0,0 +1,575 @@
+/**
+ * PortalProfiler.h - GPU 调试分组计时与 CPU 区段
+ *
+ * GPU：
+ * 每个 PushDebugGroup/PopDebugGroup 作用域在开始和结束处各发出一个 GL_TIMESTAMP 查询
+ * （GL_TIME_ELAPSED 不能嵌套，时间戳可以），得到与 RenderDoc 标记相同的层级：
+ *   Frame → 3. Portal Views → Portal L0 @ (...) Stencil=1 → Stencil Mark / Depth Clear / Scene / ...
+ *
+ * 查询按帧多缓冲：每帧开始时从最旧的帧起读取已就绪的结果，未就绪的帧留到之后再读；
+ * 只有查询集合要被复用（已落后 GPU_TIMER_FRAMES 帧）时仍未就绪才丢弃该帧，
+ * 渲染线程不会因读回而停顿，耗时长的帧也不会因为晚一两帧完成而被丢掉。解析后的每帧层级可以导出为 Chrome trace JSON
+ * （chrome://tracing 或 Perfetto 打开），并按作用域路径维护滚动百分位统计。
+ *
+ * CPU：区段写入线程私有的环形缓冲（steady_clock，开始/结束各读一次时钟，不加锁），
+ * 主线程每帧汇总一次得到各区段和 CPU 忙碌时间的滚动百分位；trace 导出时与 GPU 事件
+ * 对齐到同一时间轴，可以直接看出一帧是 CPU 受限还是 GPU 受限。
+ * PORTAL_CPU_PROFILER=0 时区段函数为空，调用点被编译器消除。
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef PORTAL_CPU_PROFILER
+#define PORTAL_CPU_PROFILER 1
+#endif
+
+namespace PortalProfiler {
+
+// 查询缓冲的帧数：一帧的结果最晚在 GPU_TIMER_FRAMES 帧之后读取，届时仍未就绪才丢弃
+// （驱动通常最多提前 2-3 帧，取 4 帧使丢弃只发生在真正的卡顿上，避免百分位偏向轻帧）
+constexpr int GPU_TIMER_FRAMES = 4;
+// 每帧查询集合的初始作用域数；一帧的作用域超出时查询集合加倍，之后各帧沿用
+constexpr int INITIAL_GPU_SCOPES = 256;
+// 每帧最多计时的作用域数（防止未配对的 Push 无限增长，超出的作用域不计时，计入 scopesDropped）
+constexpr int MAX_GPU_SCOPES = 16384;
+// 滚动百分位的窗口（帧）
+constexpr int ROLLING_WINDOW = 240;
+
+// CPU 时钟（纳秒，steady_clock），trace 的时间轴
+inline uint64_t CpuNowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 写 JSON 字符串（转义引号和反斜杠）
+inline void WriteJsonString(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', file);
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// ============================================================================
+//                          GPU 计时
+// ============================================================================
+
+/**
+ * 解析后的一个作用域（时间相对本帧第一个时间戳，毫秒）
+ */
+struct GpuScopeResult {
+    std::string name;
+    std::string path;       // 从根开始以 '/' 连接的调试分组名，作为统计的键
+    int depth = 0;
+    double startMs = 0.0;
+    double durationMs = 0.0;
+};
+
+struct GpuFrameResult {
+    uint64_t frameIndex = 0;
+    GLuint64 beginNs = 0;   // 本帧第一个时间戳（GPU 时钟）
+    std::vector<GpuScopeResult> scopes;     // 先序（与发出顺序一致）
+};
+
+/**
+ * 固定窗口的滚动样本，百分位在打印时排序计算
+ */
+struct RollingStat {
+    std::string name;
+    int depth = 0;
+    std::vector<float> samples;
+    size_t next = 0;
+
+    void Add(float value) {
+        if (samples.size() < (size_t)ROLLING_WINDOW) {
+            samples.push_back(value);
+        } else {
+            samples[next] = value;
+            next = (next + 1) % samples.size();
+        }
+    }
+
+    // p ∈ [0, 1]，sorted 为排好序的样本
+    static float Percentile(const std::vector<float>& sorted, float p) {
+        if (sorted.empty()) return 0.0f;
+        size_t index = (size_t)(p * (float)(sorted.size() - 1) + 0.5f);
+        return sorted[index];
+    }
+};
+
+/**
+ * GPU 作用域计时器
+ * 每帧 BeginFrame → 若干 Push/Pop（可嵌套）→ EndFrame，需要当前 GL 上下文
+ */
+struct GpuTimer {
+    struct Scope {
+        std::string name;
+        int parent = -1;
+        int depth = 0;
+    };
+
+    struct FrameQueries {
+        std::vector<GLuint> queries;                // 作用域 i 的开始/结束时间戳为 2i / 2i+1，按需增长
+        std::vector<Scope> scopes;
+        uint64_t frameIndex = 0;
+        bool pending = false;                       // 已发出、尚未读取
+    };
+
+    FrameQueries frames[GPU_TIMER_FRAMES];
+    int current = 0;
+    uint64_t frameIndex = 0;
+    std::vector<int> stack;                         // 打开的作用域下标（-1 = 未计时）
+    bool enabled = true;
+
+    GpuFrameResult latest;                          // 最近一次解析的帧
+    std::vector<RollingStat> rolling;               // 按首次出现顺序
+    std::unordered_map<std::string, size_t> rollingIndex;
+
+    std::vector<GpuFrameResult> trace;              // Chrome trace 捕获
+    int traceFramesRemaining = 0;
+    int64_t cpuClockOffsetNs = 0;                   // GPU 时间戳 - CpuNowNs()，StartTrace 时校准
+
+    uint64_t framesResolved = 0;
+    uint64_t framesDropped = 0;                     // 查询集合复用时结果仍未就绪而放弃的帧
+    uint64_t scopesDropped = 0;
+
+    void Create() {
+        for (FrameQueries& frame : frames) {
+            GrowQueries(frame, INITIAL_GPU_SCOPES);
+            frame.scopes.reserve(INITIAL_GPU_SCOPES);
+        }
+    }
+
+    void Destroy() {
+        for (FrameQueries& frame : frames) {
+            if (!frame.queries.empty()) glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+            frame = FrameQueries();
+        }
+    }
+
+    // 按发出顺序读取已就绪的帧，然后开始记录本帧
+    void BeginFrame() {
+        // frames[frameIndex % GPU_TIMER_FRAMES] 是最旧的帧；GPU 按顺序完成，遇到未就绪的帧就停下
+        for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+            FrameQueries& frame = frames[(frameIndex + i) % GPU_TIMER_FRAMES];
+            if (!frame.pending) continue;
+            if (!IsAvailable(frame)) break;
+            Resolve(frame);
+        }
+
+        current = (int)(frameIndex % GPU_TIMER_FRAMES);
+        FrameQueries& frame = frames[current];
+        if (frame.pending) {
+            // 已落后 GPU_TIMER_FRAMES 帧仍未完成，只能放弃
+            framesDropped++;
+        }
+        frame.scopes.clear();
+        frame.frameIndex = frameIndex;
+        frame.pending = false;
+        stack.clear();
+    }
+
+    void EndFrame() {
+        FrameQueries& frame = frames[current];
+        while (!stack.empty()) Pop();   // 容错：未配对的 Push
+        frame.pending = !frame.scopes.empty();
+        frameIndex++;
+    }
+
+    void Push(const char* name) {
+        FrameQueries& frame = frames[current];
+        if (!enabled || frame.scopes.size() == (size_t)MAX_GPU_SCOPES) {
+            if (enabled) scopesDropped++;
+            stack.push_back(-1);
+            return;
+        }
+        int index = (int)frame.scopes.size();
+        if ((size_t)index * 2 == frame.queries.size()) {
+            GrowQueries(frame, std::min(index * 2, MAX_GPU_SCOPES));
+        }
+        Scope scope;
+        scope.name = name;
+        scope.parent = stack.empty() ? -1 : stack.back();
+        scope.depth = (int)stack.size();
+        frame.scopes.push_back(scope);
+        glQueryCounter(frame.queries[index * 2], GL_TIMESTAMP);
+        stack.push_back(index);
+    }
+
+    void Pop() {
+        if (stack.empty()) return;
+        int index = stack.back();
+        stack.pop_back();
+        if (index >= 0) glQueryCounter(frames[current].queries[index * 2 + 1], GL_TIMESTAMP);
+    }
+
+    // 按发出顺序读取所有未读取的帧（先 glFinish 等待 GPU，只在运行结束时使用）
+    void Flush() {
+        glFinish();
+        for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+            FrameQueries& frame = frames[(frameIndex + i) % GPU_TIMER_FRAMES];
+            if (frame.pending) Resolve(frame);
+        }
+    }
+
+    // 捕获接下来 frameCount 帧的解析结果（由于读回延迟，最多落后 GPU_TIMER_FRAMES 帧）
+    void StartTrace(int frameCount) {
+        trace.clear();
+        traceFramesRemaining = frameCount;
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        cpuClockOffsetNs = (int64_t)gpuNow - (int64_t)CpuNowNs();
+    }
+
+    bool IsTracing() const { return traceFramesRemaining > 0; }
+
+    /**
+     * 写捕获帧的 trace 事件（"X" 完整事件，pid 2），时间换算到 CPU 时钟，相对 originNs 的微秒
+     */
+    void WriteTraceEvents(FILE* file, bool& first, uint64_t originNs) const {
+        for (const GpuFrameResult& frame : trace) {
+            double frameUs = ((double)(int64_t)(frame.beginNs - cpuClockOffsetNs) - (double)originNs) / 1000.0;
+            for (const GpuScopeResult& scope : frame.scopes) {
+                fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+                WriteJsonString(file, scope.name.c_str());
+                fprintf(file, ",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":2,\"tid\":1,"
+                              "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                        frameUs + scope.startMs * 1000.0, scope.durationMs * 1000.0,
+                        (unsigned long long)frame.frameIndex);
+                first = false;
+            }
+        }
+    }
+
+    // 按层级打印每个作用域路径的滚动 p50/p95/p99（毫秒）
+    void PrintSummary() const {
+        printf("GPU scopes (last %d frames, resolved=%llu dropped=%llu):\n", ROLLING_WINDOW,
+               (unsigned long long)framesResolved, (unsigned long long)framesDropped);
+        std::vector<float> sorted;
+        for (const RollingStat& stat : rolling) {
+            sorted = stat.samples;
+            std::sort(sorted.begin(), sorted.end());
+            printf("  %*s%-*s p50 %7.3f  p95 %7.3f  p99 %7.3f ms\n", stat.depth * 2, "",
+                   std::max(1, 48 - stat.depth * 2), stat.name.c_str(),
+                   RollingStat::Percentile(sorted, 0.50f), RollingStat::Percentile(sorted, 0.95f),
+                   RollingStat::Percentile(sorted, 0.99f));
+        }
+    }
+
+private:
+    // 把查询集合扩大到 scopeCount 个作用域（只生成新增的查询，已发出的不受影响）
+    static void GrowQueries(FrameQueries& frame, int scopeCount) {
+        size_t oldCount = frame.queries.size();
+        frame.queries.resize((size_t)scopeCount * 2);
+        glGenQueries((GLsizei)(frame.queries.size() - oldCount), frame.queries.data() + oldCount);
+    }
+
+    // 帧内全部结束时间戳都可用（不等待）
+    static bool IsAvailable(const FrameQueries& frame) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        for (size_t i = 1; i < frame.scopes.size() && available; i++) {
+            glGetQueryObjectuiv(frame.queries[i * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        }
+        return available != 0;
+    }
+
+    // 读取一帧的结果（须已就绪）
+    void Resolve(FrameQueries& frame) {
+        frame.pending = false;
+        GpuFrameResult& result = latest;
+        result.frameIndex = frame.frameIndex;
+        result.scopes.resize(frame.scopes.size());
+        std::vector<GLuint64> begin(frame.scopes.size()), end(frame.scopes.size());
+        for (size_t i = 0; i < frame.scopes.size(); i++) {
+            glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &begin[i]);
+            glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end[i]);
+        }
+        result.beginNs = begin[0];
+
+        // 同一路径在一帧内出现多次时（如同名子作用域）合计后再计入滚动统计
+        std::unordered_map<std::string, float> totals;
+        for (size_t i = 0; i < frame.scopes.size(); i++) {
+            const Scope& scope = frame.scopes[i];
+            GpuScopeResult& out = result.scopes[i];
+            out.name = scope.name;
+            out.depth = scope.depth;
+            out.path = scope.parent >= 0 ? result.scopes[scope.parent].path + "/" + scope.name : scope.name;
+            out.startMs = (double)(begin[i] - result.beginNs) / 1.0e6;
+            out.durationMs = end[i] > begin[i] ? (double)(end[i] - begin[i]) / 1.0e6 : 0.0;
+
+            auto inserted = rollingIndex.emplace(out.path, rolling.size());
+            if (inserted.second) {
+                RollingStat stat;
+                stat.name = out.name;
+                stat.depth = out.depth;
+                rolling.push_back(stat);
+            }
+            totals[out.path] += (float)out.durationMs;
+        }
+        for (const auto& total : totals) {
+            rolling[rollingIndex[total.first]].Add(total.second);
+        }
+
+        framesResolved++;
+        if (traceFramesRemaining > 0) {
+            trace.push_back(result);
+            traceFramesRemaining--;
+        }
+    }
+};
+
+// ============================================================================
+//                          CPU 区段
+// ============================================================================
+
+// 每个线程的环形缓冲容量（事件数），写满后覆盖最旧的事件
+constexpr size_t CPU_ZONE_RING_SIZE = 16384;
+// 单个线程最多记录的嵌套层数（更深的区段不记录）
+constexpr int MAX_CPU_ZONE_DEPTH = 32;
+// 区段名保留的字节数：名字被复制，调用方可以传入栈上的缓冲
+constexpr size_t CPU_ZONE_NAME_LENGTH = 48;
+
+struct CpuZoneEvent {
+    char name[CPU_ZONE_NAME_LENGTH];
+    uint64_t beginNs;
+    uint64_t endNs;
+    int depth;
+};
+
+/**
+ * 线程私有的事件环
+ * 事件在区段开始时按先序占位，最外层区段结束时以 release 发布 written。
+ * 其他线程读取时写者可能正在覆盖最旧的槽位：占位前先发布 claimed（序号锁的写者一侧），
+ * 读者复制后再读 claimed，丢弃复制期间可能已被覆盖的事件（见 Snapshot）
+ */
+struct CpuThreadBuffer {
+    std::unique_ptr<CpuZoneEvent[]> events{ new CpuZoneEvent[CPU_ZONE_RING_SIZE] };
+    std::atomic<uint64_t> written{ 0 };
+    std::atomic<uint64_t> claimed{ 0 };     // 已占位的事件数（写入槽位之前发布）
+    uint64_t reserved = 0;
+    uint64_t open[MAX_CPU_ZONE_DEPTH];      // 打开的区段的事件序号
+    int depth = 0;
+    int threadIndex = 0;
+
+    /**
+     * 其他线程：复制仍然完整的已发布事件，追加到 out
+     * 复制期间写者可能绕回覆盖最旧的槽位；复制后重新读取 claimed，
+     * 序号落在 claimed - CPU_ZONE_RING_SIZE 之前的事件可能已被部分覆盖，丢弃
+     */
+    void Snapshot(std::vector<CpuZoneEvent>& out) const {
+        uint64_t end = written.load(std::memory_order_acquire);
+        uint64_t begin = end > CPU_ZONE_RING_SIZE ? end - CPU_ZONE_RING_SIZE : 0;
+        size_t first = out.size();
+        for (uint64_t i = begin; i < end; i++) out.push_back(events[i % CPU_ZONE_RING_SIZE]);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claimedAfter = claimed.load(std::memory_order_relaxed);
+        uint64_t valid = claimedAfter > CPU_ZONE_RING_SIZE ? claimedAfter - CPU_ZONE_RING_SIZE : 0;
+        if (valid > begin) {
+            size_t torn = (size_t)std::min(valid - begin, end - begin);
+            out.erase(out.begin() + first, out.begin() + first + torn);
+        }
+    }
+};
+
+/**
+ * 进程内唯一的 CPU 区段汇总器（GetCpuProfiler()）
+ * 线程缓冲在首次使用时注册，帧统计只汇总调用 EndFrame 的线程
+ */
+struct CpuProfiler {
+    std::mutex mutex;                                   // 保护 threads
+    std::vector<std::unique_ptr<CpuThreadBuffer>> threads;
+
+    uint64_t frameStartNs = 0;
+    uint64_t frameScanned = 0;                          // 已汇总的事件序号
+    uint64_t frames = 0;
+    RollingStat busy;                                   // 每帧最外层区段的合计时间（ms）
+    std::vector<RollingStat> rolling;                   // 按区段名，首次出现顺序
+    std::unordered_map<std::string, size_t> rollingIndex;
+
+    CpuThreadBuffer& ThreadBuffer() {
+        thread_local CpuThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.emplace_back(new CpuThreadBuffer());
+            buffer = threads.back().get();
+            buffer->threadIndex = (int)threads.size() - 1;
+        }
+        return *buffer;
+    }
+
+    // 汇总本线程自上次调用以来完成的区段（每帧末尾调用一次）
+    void EndFrame() {
+#if PORTAL_CPU_PROFILER
+        CpuThreadBuffer& buffer = ThreadBuffer();
+        uint64_t end = buffer.written.load(std::memory_order_acquire);
+        uint64_t begin = std::max(frameScanned, end > CPU_ZONE_RING_SIZE ? end - CPU_ZONE_RING_SIZE : 0);
+        std::unordered_map<std::string, float> totals;
+        float busyMs = 0.0f;
+        for (uint64_t i = begin; i < end; i++) {
+            const CpuZoneEvent& event = buffer.events[i % CPU_ZONE_RING_SIZE];
+            float ms = (float)(event.endNs - event.beginNs) / 1.0e6f;
+            if (event.depth == 0) busyMs += ms;
+            auto inserted = rollingIndex.emplace(event.name, rolling.size());
+            if (inserted.second) {
+                RollingStat stat;
+                stat.name = event.name;
+                stat.depth = event.depth;
+                rolling.push_back(stat);
+            }
+            totals[event.name] += ms;
+        }
+        for (const auto& total : totals) {
+            rolling[rollingIndex[total.first]].Add(total.second);
+        }
+        busy.Add(busyMs);
+        frameScanned = end;
+        frames++;
+#endif
+    }
+
+    void PrintSummary() {
+        printf("CPU zones (last %d frames, per-frame totals):\n", ROLLING_WINDOW);
+        std::vector<float> sorted;
+        for (const RollingStat& stat : rolling) {
+            sorted = stat.samples;
+            std::sort(sorted.begin(), sorted.end());
+            printf("  %*s%-*s p50 %7.3f  p95 %7.3f  p99 %7.3f ms\n", stat.depth * 2, "",
+                   std::max(1, 48 - stat.depth * 2), stat.name.c_str(),
+                   RollingStat::Percentile(sorted, 0.50f), RollingStat::Percentile(sorted, 0.95f),
+                   RollingStat::Percentile(sorted, 0.99f));
+        }
+    }
+
+    // 写所有线程在 [fromNs, 现在] 内开始的已发布区段（pid 1，tid = 线程序号）
+    // 其他线程仍在记录，每个环先取快照，被覆盖中的事件不会写出
+    void WriteTraceEvents(FILE* file, bool& first, uint64_t fromNs, uint64_t originNs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<CpuZoneEvent> snapshot;
+        for (const std::unique_ptr<CpuThreadBuffer>& buffer : threads) {
+            snapshot.clear();
+            buffer->Snapshot(snapshot);
+            for (const CpuZoneEvent& event : snapshot) {
+                if (event.beginNs < fromNs) continue;
+                fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+                WriteJsonString(file, event.name);
+                fprintf(file, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        buffer->threadIndex + 1, (double)(event.beginNs - originNs) / 1000.0,
+                        (double)(event.endNs - event.beginNs) / 1000.0);
+                first = false;
+            }
+        }
+    }
+};
+
+inline CpuProfiler& GetCpuProfiler() {
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+// 开始/结束当前线程的一个区段（必须配对，可嵌套）
+inline void BeginCpuZone(const char* name) {
+#if PORTAL_CPU_PROFILER
+    CpuThreadBuffer& buffer = GetCpuProfiler().ThreadBuffer();
+    int depth = buffer.depth++;
+    if (depth >= MAX_CPU_ZONE_DEPTH) return;
+    uint64_t index = buffer.reserved++;
+    // 先公布占位再写槽位：读者据此识别被覆盖的旧事件
+    buffer.claimed.store(buffer.reserved, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    CpuZoneEvent& event = buffer.events[index % CPU_ZONE_RING_SIZE];
+    strncpy(event.name, name, CPU_ZONE_NAME_LENGTH - 1);
+    event.name[CPU_ZONE_NAME_LENGTH - 1] = '\0';
+    event.depth = depth;
+    buffer.open[depth] = index;
+    event.beginNs = CpuNowNs();
+#else
+    (void)name;
+#endif
+}
+
+inline void EndCpuZone() {
+#if PORTAL_CPU_PROFILER
+    uint64_t now = CpuNowNs();
+    CpuThreadBuffer& buffer = GetCpuProfiler().ThreadBuffer();
+    if (buffer.depth == 0) return;
+    int depth = --buffer.depth;
+    if (depth >= MAX_CPU_ZONE_DEPTH) return;
+    buffer.events[buffer.open[depth] % CPU_ZONE_RING_SIZE].endNs = now;
+    if (depth == 0) buffer.written.store(buffer.reserved, std::memory_order_release);
+#endif
+}
+
+/**
+ * RAII 区段，通常经由 PORTAL_CPU_ZONE 使用
+ */
+struct CpuZone {
+    explicit CpuZone(const char* name) { BeginCpuZone(name); }
+    ~CpuZone() { EndCpuZone(); }
+    CpuZone(const CpuZone&) = delete;
+    CpuZone& operator=(const CpuZone&) = delete;
+};
+
+#define PORTAL_PROFILER_JOIN_IMPL(a, b) a##b
+#define PORTAL_PROFILER_JOIN(a, b) PORTAL_PROFILER_JOIN_IMPL(a, b)
+
+#if PORTAL_CPU_PROFILER
+#define PORTAL_CPU_ZONE(name) PortalProfiler::CpuZone PORTAL_PROFILER_JOIN(portalCpuZone, __LINE__)(name)
+#else
+#define PORTAL_CPU_ZONE(name) ((void)0)
+#endif
+
+// ============================================================================
+//                          trace 与汇总
+// ============================================================================
+
+/**
+ * 写 CPU + GPU 合并的 Chrome trace：CPU 区段（pid 1，每线程一行）与 GPU 作用域（pid 2）
+ * 在同一时间轴上，时间相对 fromNs（捕获开始时的 CpuNowNs()）
+ * @return 无法写文件时返回 false
+ */
+inline bool WriteChromeTrace(const char* path, const GpuTimer& gpu, CpuProfiler& cpu, uint64_t fromNs) {
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}");
+    bool first = false;
+    cpu.WriteTraceEvents(file, first, fromNs, fromNs);
+    gpu.WriteTraceEvents(file, first, fromNs);
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
+/**
+ * 比较每帧 CPU 忙碌时间与 GPU 帧时间（根作用域）的 p50/p95，判断瓶颈在哪一侧
+ */
+inline void PrintFrameBoundSummary(const CpuProfiler& cpu, const GpuTimer& gpu) {
+    std::vector<float> cpuSorted = cpu.busy.samples;
+    std::vector<float> gpuSorted = gpu.rolling.empty() ? std::vector<float>() : gpu.rolling[0].samples;
+    if (cpuSorted.empty() || gpuSorted.empty()) return;
+    std::sort(cpuSorted.begin(), cpuSorted.end());
+    std::sort(gpuSorted.begin(), gpuSorted.end());
+    float cpu50 = RollingStat::Percentile(cpuSorted, 0.50f);
+    float gpu50 = RollingStat::Percentile(gpuSorted, 0.50f);
+    printf("Frame: CPU busy p50 %.3f / p95 %.3f ms, GPU p50 %.3f / p95 %.3f ms -> %s-bound\n",
+           cpu50, RollingStat::Percentile(cpuSorted, 0.95f), gpu50, RollingStat::Percentile(gpuSorted, 0.95f),
+           cpu50 >= gpu50 ? "CPU" : "GPU");
+}
+
+} // namespace PortalProfiler
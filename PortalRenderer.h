@@ -11,8 +11,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
 #include <functional>
+#include <cstdint>
 
 #include "PortalMath.h"
+#include "PortalGL.h"
 
 namespace PortalRenderer {
 
@@ -24,6 +26,8 @@ struct RenderContext {
     glm::vec3 cameraForward;
     int screenWidth;
     int screenHeight;
+    float time = 0.0f;
+    GLintptr uniformOffset = 0;     // 本视图在 UniformRing 中的偏移（由 RenderPortals 写入）
 };
 
 // 前向声明Portal结构体供linkedPortal指针使用
@@ -41,23 +45,48 @@ struct Portal {
     // 链接的目标门户
     Portal* linkedPortal = nullptr;
     
-    // OpenGL渲染资源
-    GLuint meshVAO = 0;
-    GLuint meshVBO = 0;
-    GLuint meshEBO = 0;
+    // 是否激活
+    bool isActive = true;
     
-    // 用于渲染到纹理的FBO和纹理
-    GLuint renderFBO = 0;
-    GLuint renderTexture = 0;
-    GLuint renderDepthBuffer = 0;
-    int textureWidth = 1024;
-    int textureHeight = 1024;
+    // 所在扇区（PortalSectors::SectorGraph 中的下标，-1 = 不参与扇区可见性）
+    int cell = -1;
     
-    // 门户着色器程序
-    GLuint shaderProgram = 0;
+    // 变换代数：每次修改 transform 后递增，使缓存的 PortalLink 失效
+    uint32_t transformGeneration = 1;
     
-    // 是否激活
-    bool isActive = true;
+    // 与 linkedPortal 之间的缓存变换（由 GetLink 按需重建）
+    mutable PortalMath::PortalLink cachedLink;
+    mutable const Portal* cachedLinkTarget = nullptr;
+    
+    /**
+     * 修改门户变换并使缓存失效
+     * 直接写 transform 字段后需调用 MarkTransformDirty()
+     */
+    void SetTransform(const glm::mat4& newTransform) {
+        transform = newTransform;
+        MarkTransformDirty();
+    }
+    
+    void MarkTransformDirty() {
+        ++transformGeneration;
+    }
+    
+    /**
+     * 获取到 linkedPortal 的缓存变换（调用前需确保 linkedPortal 非空）
+     * 任一门户的变换代数变化或链接目标改变时自动重建
+     * 重建不加锁：多个线程共享门户时，先在单线程下调用一次，之后缓存不失效才能并发调用
+     */
+    const PortalMath::PortalLink& GetLink() const {
+        if (cachedLinkTarget != linkedPortal ||
+            cachedLink.sourceGeneration != transformGeneration ||
+            cachedLink.targetGeneration != linkedPortal->transformGeneration) {
+            cachedLink = PortalMath::BuildPortalLink(transform, linkedPortal->transform);
+            cachedLink.sourceGeneration = transformGeneration;
+            cachedLink.targetGeneration = linkedPortal->transformGeneration;
+            cachedLinkTarget = linkedPortal;
+        }
+        return cachedLink;
+    }
     
     // 辅助方法获取门户位置和法线
     glm::vec3 GetPosition() const {
@@ -75,6 +104,11 @@ struct Portal {
     glm::vec3 GetRight() const {
         return glm::normalize(glm::vec3(transform[0]));
     }
+    
+    // 共享单位四边形的模型矩阵：按门户尺寸缩放后再应用门户变换
+    glm::mat4 GetModelMatrix() const {
+        return glm::scale(transform, glm::vec3(width, height, 1.0f));
+    }
 };
 
 // ============================================================================
@@ -83,40 +117,96 @@ struct Portal {
 constexpr int MAX_PORTAL_RECURSION = 4;
 
 // ============================================================================
-//                          门户渲染资源创建
+//                          模板值分配
 // ============================================================================
 
+// 模板值只编码递归深度（主视图 = 0，第 n 层门户视图 = n），占用低 STENCIL_DEPTH_BITS 位，
+// 读写都通过 STENCIL_DEPTH_MASK 进行，其余位留作他用
+constexpr int STENCIL_DEPTH_BITS = 3;
+constexpr GLuint STENCIL_DEPTH_MASK = (1u << STENCIL_DEPTH_BITS) - 1;
+static_assert(MAX_PORTAL_RECURSION <= (int)STENCIL_DEPTH_MASK, "stencil depth field too small for MAX_PORTAL_RECURSION");
+
 /**
- * 创建门户四边形网格的VAO/VBO/EBO
+ * 门户视图的模板值分配器
+ *
+ * 视图绘制时在父视图的值上 GL_INCR 标记自己的区域，子树结束封口时 GL_DECR 恢复，
+ * 所以模板值只需在"存活"视图（当前视图及其祖先）之间唯一，兄弟子树可以复用同一个值。
+ * 门户数量因此不受 8 位模板限制，只有递归深度受限。
+ *
+ * 按提交顺序（深度优先）调用 Acquire/Release，并在运行时校验不会有两个存活视图共用一个值。
  */
-inline void CreatePortalMesh(Portal* portal) {
-    float hw = portal->width * 0.5f;
-    float hh = portal->height * 0.5f;
-    
+struct StencilAllocator {
+    uint32_t liveRefs = 1u;     // 位 r 置位表示模板值 r 被存活视图占用（主视图占用 0）
+    int conflicts = 0;          // 本帧被拒绝的分配次数
+
+    void Reset() {
+        liveRefs = 1u;
+        conflicts = 0;
+    }
+
+    // 为 parentRef 的子视图分配模板值；超出深度位或与存活视图冲突时返回 -1，该视图不应渲染
+    int Acquire(int parentRef) {
+        int ref = parentRef + 1;
+        if (ref > (int)STENCIL_DEPTH_MASK || (liveRefs & (1u << ref)) || !(liveRefs & (1u << parentRef))) {
+            conflicts++;
+            return -1;
+        }
+        liveRefs |= 1u << ref;
+        return ref;
+    }
+
+    // 子树结束，归还模板值供兄弟视图复用
+    void Release(int ref) {
+        liveRefs &= ~(1u << ref);
+    }
+};
+
+// ============================================================================
+//                          门户渲染资源
+// ============================================================================
+
+/**
+ * 所有门户共享的GPU资源：一个不可变的单位四边形（±0.5，按 Portal::GetModelMatrix 缩放）
+ * 和一个门户着色器程序。门户数量增加不会增加网格或程序对象
+ */
+struct PortalResources {
+    GLuint quadVAO = 0;
+    GLuint quadVBO = 0;
+    GLuint quadEBO = 0;
+    PortalGL::ShaderProgram program;
+};
+
+inline const char* GetPortalVertexShaderSource();
+inline const char* GetPortalFragmentShaderSource();
+
+/**
+ * 创建共享的单位四边形网格和门户着色器（整个程序只需调用一次）
+ */
+inline void CreatePortalResources(PortalResources& resources) {
     // 顶点数据: position (3), normal (3), uv (2)
-    float vertices[] = {
+    const float vertices[] = {
         // pos              // normal     // uv
-        -hw, -hh, 0.0f,     0, 0, 1,      0, 0,
-         hw, -hh, 0.0f,     0, 0, 1,      1, 0,
-         hw,  hh, 0.0f,     0, 0, 1,      1, 1,
-        -hw,  hh, 0.0f,     0, 0, 1,      0, 1
+        -0.5f, -0.5f, 0.0f, 0, 0, 1,      0, 0,
+         0.5f, -0.5f, 0.0f, 0, 0, 1,      1, 0,
+         0.5f,  0.5f, 0.0f, 0, 0, 1,      1, 1,
+        -0.5f,  0.5f, 0.0f, 0, 0, 1,      0, 1
     };
     
-    unsigned int indices[] = {
+    const unsigned int indices[] = {
         0, 1, 2,
         2, 3, 0
     };
     
-    glGenVertexArrays(1, &portal->meshVAO);
-    glGenBuffers(1, &portal->meshVBO);
-    glGenBuffers(1, &portal->meshEBO);
+    glGenVertexArrays(1, &resources.quadVAO);
+    glGenBuffers(1, &resources.quadVBO);
+    glGenBuffers(1, &resources.quadEBO);
     
-    glBindVertexArray(portal->meshVAO);
+    glBindVertexArray(resources.quadVAO);
     
-    glBindBuffer(GL_ARRAY_BUFFER, portal->meshVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, resources.quadVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, portal->meshEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources.quadEBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
     
     // Position attribute
@@ -130,69 +220,27 @@ inline void CreatePortalMesh(Portal* portal) {
     glEnableVertexAttribArray(2);
     
     glBindVertexArray(0);
-}
-
-/**
- * 创建门户渲染目标（FBO + Color Texture + Depth Buffer）
- */
-inline void CreatePortalRenderTarget(Portal* portal, int width, int height) {
-    portal->textureWidth = width;
-    portal->textureHeight = height;
-    
-    // 创建FBO
-    glGenFramebuffers(1, &portal->renderFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, portal->renderFBO);
-    
-    // 创建颜色纹理
-    glGenTextures(1, &portal->renderTexture);
-    glBindTexture(GL_TEXTURE_2D, portal->renderTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, portal->renderTexture, 0);
-    
-    // 创建深度/模板 Renderbuffer
-    glGenRenderbuffers(1, &portal->renderDepthBuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, portal->renderDepthBuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, portal->renderDepthBuffer);
-    
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        // 错误处理: FBO不完整
-    }
     
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    resources.program.Build("portal", GetPortalVertexShaderSource(), GetPortalFragmentShaderSource());
 }
 
-/**
- * 销毁门户资源
- */
-inline void DestroyPortal(Portal* portal) {
-    if (portal->meshVAO) {
-        glDeleteVertexArrays(1, &portal->meshVAO);
-        glDeleteBuffers(1, &portal->meshVBO);
-        glDeleteBuffers(1, &portal->meshEBO);
-    }
-    if (portal->renderFBO) {
-        glDeleteFramebuffers(1, &portal->renderFBO);
-        glDeleteTextures(1, &portal->renderTexture);
-        glDeleteRenderbuffers(1, &portal->renderDepthBuffer);
-    }
-    if (portal->shaderProgram) {
-        glDeleteProgram(portal->shaderProgram);
+inline void DestroyPortalResources(PortalResources& resources) {
+    if (resources.quadVAO) {
+        glDeleteVertexArrays(1, &resources.quadVAO);
+        glDeleteBuffers(1, &resources.quadVBO);
+        glDeleteBuffers(1, &resources.quadEBO);
     }
+    resources.program.Destroy();
+    resources = PortalResources();
 }
 
 // ============================================================================
 //                          门户着色器
 // ============================================================================
 
-// 门户顶点着色器源码
+// 门户顶点着色器源码（#version 与 ViewBlock 由 PortalGL::ShaderProgram 拼接）
 inline const char* GetPortalVertexShaderSource() {
     return R"(
-#version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
@@ -202,14 +250,12 @@ out vec3 vNormal;
 out vec4 vClipPos;
 
 uniform mat4 uModel;
-uniform mat4 uView;
-uniform mat4 uProjection;
 
 void main() {
     vec4 worldPos = uModel * vec4(aPos, 1.0);
     vWorldPos = worldPos.xyz;
     vNormal = mat3(transpose(inverse(uModel))) * aNormal;
-    vClipPos = uProjection * uView * worldPos;
+    vClipPos = uViewProjection * worldPos;
     gl_Position = vClipPos;
 }
 )";
@@ -218,78 +264,33 @@ void main() {
 // 门户片段着色器源码
 inline const char* GetPortalFragmentShaderSource() {
     return R"(
-#version 330 core
 in vec3 vWorldPos;
 in vec3 vNormal;
 in vec4 vClipPos;
 
 out vec4 FragColor;
 
-uniform sampler2D uPortalTexture;
-uniform vec3 uCameraPos;
-uniform float uTime;
-
 void main() {
+    vec3 cameraPos = uCameraPosTime.xyz;
+    float time = uCameraPosTime.w;
+    
     // 计算屏幕空间UV (从clip坐标转换到0-1范围)
     vec2 screenUV = (vClipPos.xy / vClipPos.w) * 0.5 + 0.5;
     
-    // 采样门户纹理
-    vec4 portalColor = texture(uPortalTexture, screenUV);
-    
     // 添加门户边缘效果
-    float fresnel = 1.0 - abs(dot(normalize(vNormal), normalize(uCameraPos - vWorldPos)));
+    float fresnel = 1.0 - abs(dot(normalize(vNormal), normalize(cameraPos - vWorldPos)));
     vec3 edgeColor = vec3(0.2, 0.6, 1.0) * fresnel * fresnel;
     
     // 时间扭曲效果
-    float wave = sin(uTime * 3.0 + length(screenUV - 0.5) * 20.0) * 0.5 + 0.5;
+    float wave = sin(time * 3.0 + length(screenUV - 0.5) * 20.0) * 0.5 + 0.5;
     edgeColor *= 1.0 + wave * 0.3;
     
-    FragColor = portalColor + vec4(edgeColor * 0.3, 0.0);
+    // 门户视图已经用模板画在帧缓冲上，这里只输出叠加的边缘光（加法混合）
+    FragColor = vec4(edgeColor * 0.3, 0.0);
 }
 )";
 }
 
-/**
- * 编译并链接着色器程序
- */
-inline GLuint CompilePortalShader() {
-    auto compileShader = [](GLenum type, const char* source) -> GLuint {
-        GLuint shader = glCreateShader(type);
-        glShaderSource(shader, 1, &source, nullptr);
-        glCompileShader(shader);
-        
-        GLint success;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-            // 错误日志输出
-        }
-        return shader;
-    };
-    
-    GLuint vertShader = compileShader(GL_VERTEX_SHADER, GetPortalVertexShaderSource());
-    GLuint fragShader = compileShader(GL_FRAGMENT_SHADER, GetPortalFragmentShaderSource());
-    
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vertShader);
-    glAttachShader(program, fragShader);
-    glLinkProgram(program);
-    
-    GLint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        // 链接错误日志
-    }
-    
-    glDeleteShader(vertShader);
-    glDeleteShader(fragShader);
-    
-    return program;
-}
-
 // ============================================================================
 //                   递归门户渲染核心逻辑
 // ============================================================================
@@ -307,76 +308,79 @@ using SceneRenderCallback = std::function<void(const glm::mat4& view, const glm:
  * @param context         渲染上下文
  * @param currentRecursion 当前递归深度
  * @param allPortals      所有门户列表（用于嵌套渲染）
- * @param renderScene     场景渲染回调
+ * @param resources       共享的门户网格和着色器
+ * @param ring            每视图 uniform 缓冲（context.uniformOffset 已写入）
+ * @param renderScene     场景渲染回调（调用时 ViewBlock 已绑定到虚拟视图）
  */
 inline void RenderPortalRecursive(
     Portal* portal,
     const RenderContext& context,
     int currentRecursion,
     std::vector<Portal*>& allPortals,
+    const PortalResources& resources,
+    PortalGL::UniformRing& ring,
     const SceneRenderCallback& renderScene
 ) {
     if (currentRecursion >= MAX_PORTAL_RECURSION) return;
     if (!portal->linkedPortal || !portal->isActive) return;
     
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    
     // ========================================================================
     // Step 1: 计算通过此门户观看的虚拟相机
     // ========================================================================
-    glm::mat4 virtualView = PortalMath::CalculatePortalView(
-        portal->transform,
-        portal->linkedPortal->transform,
-        context.viewMatrix
-    );
+    const PortalMath::PortalLink& link = portal->GetLink();
+    glm::mat4 virtualView = PortalMath::CalculatePortalViewMatrix(context.viewMatrix, link);
     
-    glm::vec3 virtualCameraPos = glm::vec3(glm::inverse(virtualView)[3]);
+    glm::vec3 virtualCameraPos = PortalMath::TeleportPosition(context.cameraPosition, link);
     
     // ========================================================================
     // Step 2: 使用斜切近平面的投影矩阵
     // ========================================================================
     // 目标门户平面作为裁剪平面 (在世界空间)
-    glm::vec4 portalPlaneWorld = PortalMath::GetPortalPlane(portal->linkedPortal->transform);
+    glm::vec4 portalPlaneWorld = link.targetPlane;
     
-    glm::mat4 obliqueProj = PortalMath::CalculateObliqueProjection(
+    // 视图矩阵是刚体变换，平面变换无需求逆
+    glm::mat4 obliqueProj = PortalMath::CalculateObliqueProjectionMatrix(
         context.projectionMatrix,
-        virtualView,
-        portalPlaneWorld
+        PortalMath::TransformPlaneRigid(portalPlaneWorld, virtualView)
     );
     
     // ========================================================================
     // Step 3: 设置模板缓冲区 - 只在门户区域内渲染
     // ========================================================================
-    glEnable(GL_STENCIL_TEST);
+    state.Enable(GL_STENCIL_TEST);
     
     // 绘制门户形状来设置模板值
-    glStencilFunc(GL_EQUAL, currentRecursion, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glDepthMask(GL_FALSE);
+    state.StencilFunc(GL_EQUAL, currentRecursion, 0xFF);
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    state.DepthMask(GL_FALSE);
     
     // 渲染门户四边形到模板缓冲区
-    glUseProgram(portal->shaderProgram);
-    glBindVertexArray(portal->meshVAO);
+    state.UseProgram(resources.program.id);
+    state.BindVertexArray(resources.quadVAO);
     
-    // 设置uniforms
-    glUniformMatrix4fv(glGetUniformLocation(portal->shaderProgram, "uModel"), 1, GL_FALSE, &portal->transform[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(portal->shaderProgram, "uView"), 1, GL_FALSE, &context.viewMatrix[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(portal->shaderProgram, "uProjection"), 1, GL_FALSE, &context.projectionMatrix[0][0]);
+    // 设置uniforms：视图数据来自当前视图的 ViewBlock，只需上传模型矩阵
+    ring.Bind(context.uniformOffset);
+    glm::mat4 model = portal->GetModelMatrix();
+    glUniformMatrix4fv(resources.program[PortalGL::UNIFORM_MODEL], 1, GL_FALSE, &model[0][0]);
     
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     
     // ========================================================================
     // Step 4: 清除门户区域的深度缓冲区
     // ========================================================================
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_ALWAYS);
-    glStencilFunc(GL_EQUAL, currentRecursion + 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    state.DepthMask(GL_TRUE);
+    state.DepthFunc(GL_ALWAYS);
+    state.StencilFunc(GL_EQUAL, currentRecursion + 1, 0xFF);
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
     
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     
-    glDepthFunc(GL_LESS);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    state.DepthFunc(GL_LESS);
+    state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     
     // ========================================================================
     // Step 5: 递归渲染其他门户（在当前门户视角下）
@@ -385,76 +389,94 @@ inline void RenderPortalRecursive(
     nestedContext.viewMatrix = virtualView;
     nestedContext.projectionMatrix = obliqueProj;
     nestedContext.cameraPosition = virtualCameraPos;
+    nestedContext.uniformOffset = ring.Push(
+        PortalGL::MakeViewUniforms(virtualView, obliqueProj, virtualCameraPos, context.time));
     
     for (Portal* otherPortal : allPortals) {
         if (otherPortal != portal && otherPortal->isActive) {
-            RenderPortalRecursive(otherPortal, nestedContext, currentRecursion + 1, allPortals, renderScene);
+            RenderPortalRecursive(otherPortal, nestedContext, currentRecursion + 1, allPortals, resources, ring, renderScene);
         }
     }
     
     // ========================================================================
     // Step 6: 渲染通过门户看到的场景
     // ========================================================================
-    glStencilFunc(GL_EQUAL, currentRecursion + 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    state.StencilFunc(GL_EQUAL, currentRecursion + 1, 0xFF);
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
     
     // 调用用户提供的场景渲染函数
+    ring.Bind(nestedContext.uniformOffset);
     renderScene(virtualView, obliqueProj);
     
     // ========================================================================
     // Step 7: 恢复模板值（递减回原来的层级）
     // ========================================================================
-    glStencilFunc(GL_EQUAL, currentRecursion + 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_DECR);
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glDepthMask(GL_FALSE);
+    state.StencilFunc(GL_EQUAL, currentRecursion + 1, 0xFF);
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_DECR);
+    state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    state.DepthMask(GL_FALSE);
+    
+    // 场景回调可能切换了程序和顶点数组，恢复当前视图下的门户四边形
+    state.UseProgram(resources.program.id);
+    state.BindVertexArray(resources.quadVAO);
+    ring.Bind(context.uniformOffset);
+    glUniformMatrix4fv(resources.program[PortalGL::UNIFORM_MODEL], 1, GL_FALSE, &model[0][0]);
     
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glDepthMask(GL_TRUE);
-    glBindVertexArray(0);
+    state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    state.DepthMask(GL_TRUE);
 }
 
 /**
  * 渲染所有门户
+ * 门户视图直接画在当前帧缓冲的模板区域内，最后的边框效果用加法混合叠加在门户视图上
+ * ring 需已在本帧 BeginFrame，每个视图的 ViewBlock 只写入一次
  */
 inline void RenderPortals(
     std::vector<Portal*>& portals,
     const RenderContext& context,
+    const PortalResources& resources,
+    PortalGL::UniformRing& ring,
     const SceneRenderCallback& renderScene
 ) {
-    // 清除模板缓冲区为0
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    RenderContext rootContext = context;
+    rootContext.uniformOffset = ring.Push(PortalGL::MakeViewUniforms(
+        context.viewMatrix, context.projectionMatrix, context.cameraPosition, context.time));
+    
+    // 清除模板缓冲区为0（清除受模板写掩码影响）
+    state.StencilMask(0xFF);
     glClearStencil(0);
     glClear(GL_STENCIL_BUFFER_BIT);
     
     // 对每个门户进行递归渲染
     for (Portal* portal : portals) {
-        RenderPortalRecursive(portal, context, 0, portals, renderScene);
+        RenderPortalRecursive(portal, rootContext, 0, portals, resources, ring, renderScene);
     }
     
     // 最后绘制门户边框效果
-    glDisable(GL_STENCIL_TEST);
+    state.Disable(GL_STENCIL_TEST);
+    
+    // 所有门户共用同一程序和网格，只在循环外绑定一次
+    state.UseProgram(resources.program.id);
+    state.BindVertexArray(resources.quadVAO);
+    ring.Bind(rootContext.uniformOffset);
+    state.Enable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    state.DepthMask(GL_FALSE);
     
     for (Portal* portal : portals) {
         if (!portal->isActive) continue;
         
-        glUseProgram(portal->shaderProgram);
-        glBindVertexArray(portal->meshVAO);
-        
-        // 绑定门户纹理
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, portal->renderTexture);
-        glUniform1i(glGetUniformLocation(portal->shaderProgram, "uPortalTexture"), 0);
-        
-        glUniformMatrix4fv(glGetUniformLocation(portal->shaderProgram, "uModel"), 1, GL_FALSE, &portal->transform[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(portal->shaderProgram, "uView"), 1, GL_FALSE, &context.viewMatrix[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(portal->shaderProgram, "uProjection"), 1, GL_FALSE, &context.projectionMatrix[0][0]);
-        glUniform3fv(glGetUniformLocation(portal->shaderProgram, "uCameraPos"), 1, &context.cameraPosition[0]);
+        glm::mat4 model = portal->GetModelMatrix();
+        glUniformMatrix4fv(resources.program[PortalGL::UNIFORM_MODEL], 1, GL_FALSE, &model[0][0]);
         
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
     }
+    
+    state.DepthMask(GL_TRUE);
+    state.Disable(GL_BLEND);
 }
 
 } // namespace PortalRenderer
@@ -0,0 +1,215 @@
+/**
+ * PortalSectors.h - 扇区（cell）与开口构成的可见性图
+ *
+ * 关卡划分为若干扇区，几何体属于扇区，扇区之间通过开口（门洞、窗口、敞开的屋顶）相连；
+ * 传送门户也属于某个扇区，视图穿过门户后从出口门户所在的扇区继续。
+ * 遍历（Luebke & Georges 1995）从相机所在扇区开始，只穿过相机位于正确一侧、且与当前裁剪体
+ * 相交的开口，每穿过一个开口就把裁剪体收窄为穿过该开口的孔径视锥体。
+ * 结果是一组 (扇区, 裁剪体)：只有这些扇区的物体、并且只针对各自的裁剪体才会被提交。
+ *
+ * 扇区的区域是一个轴对齐包围盒；可以有一个无边界扇区（户外），表示其余全部空间。
+ */
+
+#pragma once
+
+#include "PortalCulling.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace PortalSectors {
+
+// 一条遍历路径最多穿过的开口数
+constexpr int MAX_SECTOR_DEPTH = 16;
+// 相机到开口平面的距离小于此值时认为相机正站在开口中：孔径退化，沿用当前裁剪体（保守）
+constexpr float OPENING_PLANE_EPSILON = 0.05f;
+// 物体包围盒与扇区区域比较时的容差
+constexpr float CELL_BOUNDS_EPSILON = 0.001f;
+
+struct Cell {
+    std::string name;
+    glm::vec3 boundsMin{ 0.0f };
+    glm::vec3 boundsMax{ 0.0f };
+    bool bounded = true;                    // false：户外扇区，区域为其他扇区之外的全部空间
+    std::vector<int> openings;              // 与本扇区相连的开口
+    std::vector<int> objects;               // 属于本扇区的物体（跨边界的物体同时属于多个扇区）
+    PortalCulling::Bvh bvh;                 // objects 的 BVH，叶子中的下标指向 objects
+};
+
+/**
+ * 两个扇区之间的开口（双向可穿过）
+ * 平面法线指向 front 扇区，相机在 front 一侧时才能看进 back，反之亦然
+ */
+struct Opening {
+    int front = -1;
+    int back = -1;
+    PortalCulling::ConvexPolygon polygon;   // 世界空间凸多边形
+    glm::vec4 plane{ 0.0f };
+};
+
+// 遍历结果：一个可达扇区及到达它时的裁剪体（同一扇区经不同路径可出现多次）
+struct CellVisit {
+    int cell;
+    PortalCulling::Frustum frustum;
+};
+
+/**
+ * 矩形开口：corner、corner + edgeU、corner + edgeU + edgeV、corner + edgeV
+ * 平面法线为 cross(edgeU, edgeV)
+ */
+inline PortalCulling::ConvexPolygon MakeRectangle(const glm::vec3& corner, const glm::vec3& edgeU, const glm::vec3& edgeV) {
+    PortalCulling::ConvexPolygon polygon;
+    polygon.vertices[0] = corner;
+    polygon.vertices[1] = corner + edgeU;
+    polygon.vertices[2] = corner + edgeU + edgeV;
+    polygon.vertices[3] = corner + edgeV;
+    polygon.count = 4;
+    return polygon;
+}
+
+// a 的每个分量都不大于 b
+inline bool AllLessEqual(const glm::vec3& a, const glm::vec3& b) {
+    return a.x <= b.x && a.y <= b.y && a.z <= b.z;
+}
+
+inline bool AllLess(const glm::vec3& a, const glm::vec3& b) {
+    return a.x < b.x && a.y < b.y && a.z < b.z;
+}
+
+struct SectorGraph {
+    std::vector<Cell> cells;
+    std::vector<Opening> openings;
+    int outsideCell = -1;                   // 无边界扇区（最多一个）
+
+    int AddCell(const std::string& name, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        Cell cell;
+        cell.name = name;
+        cell.boundsMin = boundsMin;
+        cell.boundsMax = boundsMax;
+        cells.push_back(cell);
+        return (int)cells.size() - 1;
+    }
+
+    int AddOutsideCell(const std::string& name) {
+        Cell cell;
+        cell.name = name;
+        cell.bounded = false;
+        cells.push_back(cell);
+        outsideCell = (int)cells.size() - 1;
+        return outsideCell;
+    }
+
+    /**
+     * 连接两个扇区
+     * @param polygon 开口多边形，按右手定则其法线指向 front 扇区
+     */
+    int AddOpening(int front, int back, const PortalCulling::ConvexPolygon& polygon) {
+        Opening opening;
+        opening.front = front;
+        opening.back = back;
+        opening.polygon = polygon;
+        glm::vec3 normal = glm::normalize(glm::cross(polygon.vertices[1] - polygon.vertices[0],
+                                                     polygon.vertices[2] - polygon.vertices[0]));
+        opening.plane = glm::vec4(normal, -glm::dot(normal, polygon.vertices[0]));
+        openings.push_back(opening);
+        int index = (int)openings.size() - 1;
+        cells[front].openings.push_back(index);
+        cells[back].openings.push_back(index);
+        return index;
+    }
+
+    // 包含该点的扇区：先查有边界的扇区，都不包含时为户外扇区（没有户外扇区时为 -1）
+    int Locate(const glm::vec3& point) const {
+        for (size_t i = 0; i < cells.size(); i++) {
+            const Cell& cell = cells[i];
+            if (cell.bounded && AllLessEqual(cell.boundsMin, point) && AllLessEqual(point, cell.boundsMax)) {
+                return (int)i;
+            }
+        }
+        return outsideCell;
+    }
+
+    /**
+     * 把物体分配到扇区并为每个扇区构建 BVH
+     * 物体属于与其包围盒相交的每个有边界扇区；没有被某个扇区严格包含的物体
+     * （位于墙面上或伸出房间的物体）同时属于户外扇区，两侧都能看到
+     */
+    void AssignObjects(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax) {
+        for (Cell& cell : cells) cell.objects.clear();
+        glm::vec3 epsilon(CELL_BOUNDS_EPSILON);
+        for (size_t i = 0; i < boundsMin.size(); i++) {
+            bool enclosed = false;
+            for (Cell& cell : cells) {
+                if (!cell.bounded) continue;
+                if (AllLessEqual(boundsMin[i], cell.boundsMax + epsilon) &&
+                    AllLessEqual(cell.boundsMin - epsilon, boundsMax[i])) {
+                    cell.objects.push_back((int)i);
+                }
+                if (AllLess(cell.boundsMin + epsilon, boundsMin[i]) && AllLess(boundsMax[i], cell.boundsMax - epsilon)) {
+                    enclosed = true;
+                }
+            }
+            if (!enclosed && outsideCell >= 0) cells[outsideCell].objects.push_back((int)i);
+        }
+
+        std::vector<glm::vec3> cellMin, cellMax;
+        for (Cell& cell : cells) {
+            cellMin.clear();
+            cellMax.clear();
+            for (int object : cell.objects) {
+                cellMin.push_back(boundsMin[object]);
+                cellMax.push_back(boundsMax[object]);
+            }
+            cell.bvh.Build(cellMin, cellMax);
+        }
+    }
+
+    /**
+     * 从 startCell 出发遍历可达扇区，把 (扇区, 裁剪体) 追加到 visits
+     * 同一条路径不会重复进入一个扇区；startCell < 0（相机在所有扇区之外）时保守地返回全部扇区
+     *
+     * @param cameraPos （虚拟）相机世界位置，开口的朝向测试和孔径视锥体都基于它
+     * @param frustum   起始裁剪体（主视图视锥体或门户孔径视锥体）
+     */
+    void Traverse(int startCell, const glm::vec3& cameraPos, const PortalCulling::Frustum& frustum,
+                  std::vector<CellVisit>& visits) const {
+        if (startCell < 0) {
+            for (size_t i = 0; i < cells.size(); i++) visits.push_back({ (int)i, frustum });
+            return;
+        }
+        int path[MAX_SECTOR_DEPTH + 1];
+        Walk(startCell, cameraPos, frustum, path, 0, visits);
+    }
+
+private:
+    void Walk(int cellIndex, const glm::vec3& cameraPos, const PortalCulling::Frustum& frustum,
+              int* path, int depth, std::vector<CellVisit>& visits) const {
+        visits.push_back({ cellIndex, frustum });
+        path[depth] = cellIndex;
+        if (depth == MAX_SECTOR_DEPTH) return;
+
+        for (int openingIndex : cells[cellIndex].openings) {
+            const Opening& opening = openings[openingIndex];
+            int next = opening.front == cellIndex ? opening.back : opening.front;
+            if (std::find(path, path + depth + 1, next) != path + depth + 1) continue;
+
+            // 相机必须在当前扇区一侧才能透过开口看到 next
+            float distance = glm::dot(glm::vec3(opening.plane), cameraPos) + opening.plane.w;
+            if (opening.front != cellIndex) distance = -distance;
+            if (distance < -OPENING_PLANE_EPSILON) continue;
+
+            PortalCulling::ConvexPolygon aperture = PortalCulling::ClipPolygon(opening.polygon, frustum);
+            if (aperture.IsEmpty()) continue;
+            if (distance <= OPENING_PLANE_EPSILON) {
+                Walk(next, cameraPos, frustum, path, depth + 1, visits);
+            } else {
+                Walk(next, cameraPos, PortalCulling::BuildApertureFrustum(cameraPos, aperture, opening.plane),
+                     path, depth + 1, visits);
+            }
+        }
+    }
+};
+
+} // namespace PortalSectors
@@ -0,0 +1,109 @@
+/**
+ * PortalSimulation.h - 固定步长的模拟线程与快照交接
+ *
+ * 模拟（玩家移动、传送检测）在独立线程上按固定频率推进，与渲染帧率无关；
+ * 每个 tick 结束时把渲染需要的状态写入三缓冲的写者槽位并发布，渲染线程在帧开始时
+ * 取走最新的一份。两侧都不等待对方：渲染卡顿不会拖慢模拟，模拟也不会阻塞渲染。
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace PortalSimulation {
+
+// 模拟落后超过这么多 tick 时丢弃积压，而不是连续追赶
+constexpr int MAX_CATCH_UP_TICKS = 8;
+
+/**
+ * 单写者单读者三缓冲
+ * 写者和读者各独占一个槽位，第三个槽位通过原子交换传递；DIRTY 位表示中间槽位比读者的新
+ */
+template<typename T>
+struct TripleBuffer {
+    static constexpr uint8_t INDEX_MASK = 3;
+    static constexpr uint8_t DIRTY = 4;
+
+    T slots[3];
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t back = 0;       // 写者独占
+    uint8_t front = 2;      // 读者独占
+
+    // 写者：填写 Back() 后调用 Publish()
+    T& Back() { return slots[back]; }
+
+    void Publish() {
+        back = middle.exchange((uint8_t)(back | DIRTY), std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // 读者：有新发布的槽位时换入并返回 true，之后 Front() 为最新的一份
+    bool Update() {
+        if (!(middle.load(std::memory_order_relaxed) & DIRTY)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& Front() const { return slots[front]; }
+
+    // 线程启动前：三个槽位都设为同一初始值
+    void Reset(const T& value) {
+        slots[0] = slots[1] = slots[2] = value;
+        middle.store(1, std::memory_order_relaxed);
+        back = 0;
+        front = 2;
+    }
+};
+
+/**
+ * 按固定频率调用 tick(tickIndex, dt) 的后台线程
+ * 按绝对时间排程，单个 tick 超时后会连续补上；落后超过 MAX_CATCH_UP_TICKS 时跳过积压并计数
+ */
+struct FixedTickThread {
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    std::atomic<uint64_t> ticks{ 0 };           // 已执行的 tick 数
+    std::atomic<uint64_t> ticksSkipped{ 0 };    // 因落后而丢弃的 tick 数
+    double tickSeconds = 0.0;
+
+    template<typename Tick>
+    void Start(double tickRate, Tick tick) {
+        if (running.load()) return;
+        tickSeconds = 1.0 / tickRate;
+        running.store(true);
+        thread = std::thread([this, tick]() {
+            using Clock = std::chrono::steady_clock;
+            const Clock::duration step = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(tickSeconds));
+            Clock::time_point next = Clock::now();
+            float dt = (float)tickSeconds;
+            while (running.load(std::memory_order_relaxed)) {
+                Clock::time_point now = Clock::now();
+                if (now < next) {
+                    std::this_thread::sleep_until(next);
+                    continue;
+                }
+                if (now - next > step * MAX_CATCH_UP_TICKS) {
+                    uint64_t behind = (uint64_t)((now - next) / step);
+                    ticksSkipped.fetch_add(behind, std::memory_order_relaxed);
+                    next += step * (Clock::duration::rep)behind;
+                }
+                tick(ticks.load(std::memory_order_relaxed), dt);
+                ticks.fetch_add(1, std::memory_order_relaxed);
+                next += step;
+            }
+        });
+    }
+
+    void Stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+    }
+
+    ~FixedTickThread() { Stop(); }
+};
+
+} // namespace PortalSimulation
@@ -10,6 +10,9 @@
 
 namespace PortalTeleporter {
 
+// 传送冷却时间，防止在门户平面附近连续触发
+constexpr float TELEPORT_COOLDOWN = 0.3f; // 300ms cooldown
+
 struct TeleportableEntity {
     glm::vec3 position;
     glm::vec3 previousPosition;
@@ -25,6 +28,12 @@ inline bool IsPointInPortalBounds(const glm::vec3& worldPoint, const glm::mat4&
     return (std::abs(localPoint.x) <= halfWidth && std::abs(localPoint.y) <= halfHeight);
 }
 
+// 使用 PortalLink 中缓存的入口门户局部空间，避免每次测试求逆
+inline bool IsPointInPortalBounds(const glm::vec3& worldPoint, const PortalMath::PortalLink& link, float halfWidth, float halfHeight) {
+    glm::vec4 localPoint = link.sourceInverse * glm::vec4(worldPoint, 1.0f);
+    return (std::abs(localPoint.x) <= halfWidth && std::abs(localPoint.y) <= halfHeight);
+}
+
 // Helper to get current time - using static counter for portability
 inline float GetCurrentTime() {
     static float s_time = 0.0f;
@@ -40,13 +49,16 @@ inline void SetCurrentTime(float time) {
 // 支持从任意一面穿过门户进行传送
 inline bool ShouldTeleport(TeleportableEntity& entity, const PortalRenderer::Portal* portal, float halfWidth, float halfHeight, float currentTime = 0.0f) {
     // Cooldown check - prevent rapid teleportation
-    const float TELEPORT_COOLDOWN = 0.3f; // 300ms cooldown
     if (currentTime > 0.0f && (currentTime - entity.lastTeleportTime) < TELEPORT_COOLDOWN) {
         return false;
     }
     
-    float prevDist = PortalMath::GetSignedDistanceToPortal(entity.previousPosition, portal->transform);
-    float currDist = PortalMath::GetSignedDistanceToPortal(entity.position, portal->transform);
+    // 未链接的门户无法传送
+    if (!portal->linkedPortal) return false;
+    
+    const PortalMath::PortalLink& link = portal->GetLink();
+    float prevDist = PortalMath::GetSignedDistanceToPlane(entity.previousPosition, link.sourcePlane);
+    float currDist = PortalMath::GetSignedDistanceToPlane(entity.position, link.sourcePlane);
     
     // 双面门户：检测是否穿过门户平面（无论从哪一面）
     // 条件：前后帧的符号不同（或其中一个为0）
@@ -59,23 +71,32 @@ inline bool ShouldTeleport(TeleportableEntity& entity, const PortalRenderer::Por
     float t = prevDist / (prevDist - currDist);
     glm::vec3 crossPoint = glm::mix(entity.previousPosition, entity.position, t);
     
-    if (IsPointInPortalBounds(crossPoint, portal->transform, halfWidth, halfHeight)) {
+    if (IsPointInPortalBounds(crossPoint, link, halfWidth, halfHeight)) {
         entity.lastTeleportTime = currentTime;
         return true;
     }
     return false;
 }
 
+inline void TeleportEntity(TeleportableEntity& entity, const PortalMath::PortalLink& link) {
+    entity.position = PortalMath::TeleportPosition(entity.position, link);
+    entity.previousPosition = PortalMath::TeleportPosition(entity.previousPosition, link);
+    entity.velocity = PortalMath::TeleportDirection(entity.velocity, link) * glm::length(entity.velocity);
+    entity.transform = PortalMath::TeleportMatrix(entity.transform, link);
+}
+
 inline void TeleportEntity(TeleportableEntity& entity, const PortalRenderer::Portal* sourcePortal, const PortalRenderer::Portal* targetPortal) {
-    entity.position = PortalMath::TeleportPosition(entity.position, sourcePortal->transform, targetPortal->transform);
-    entity.previousPosition = PortalMath::TeleportPosition(entity.previousPosition, sourcePortal->transform, targetPortal->transform);
-    entity.velocity = PortalMath::TeleportDirection(entity.velocity, sourcePortal->transform, targetPortal->transform) * glm::length(entity.velocity);
-    entity.transform = PortalMath::TeleportMatrix(entity.transform, sourcePortal->transform, targetPortal->transform);
+    // 常见情况：目标就是链接门户，直接使用缓存
+    if (targetPortal == sourcePortal->linkedPortal) {
+        TeleportEntity(entity, sourcePortal->GetLink());
+        return;
+    }
+    TeleportEntity(entity, PortalMath::BuildPortalLink(sourcePortal->transform, targetPortal->transform));
 }
 
 inline glm::mat4 CalculateCloneTransform(const glm::mat4& entityTransform, const PortalRenderer::Portal* portal) {
     if (!portal->linkedPortal) return entityTransform;
-    return PortalMath::TeleportMatrix(entityTransform, portal->transform, portal->linkedPortal->transform);
+    return PortalMath::TeleportMatrix(entityTransform, portal->GetLink());
 }
 
 inline bool ShouldRenderClone(const TeleportableEntity& entity, const PortalRenderer::Portal* portal, float threshold) {
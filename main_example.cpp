@@ -5,6 +5,17 @@
 #include "PortalMath.h"
 #include "PortalRenderer.h"
 #include "PortalTeleporter.h"
+#include "PortalCulling.h"
+#include "PortalGL.h"
+#include "PortalGeometry.h"
+#include "PortalProfiler.h"
+#include "PortalLog.h"
+#include "PortalSimulation.h"
+#include "PortalJobs.h"
+#include "PortalSectors.h"
+#ifdef PORTAL_HEADLESS
+#include "PortalHeadless.h"
+#endif
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -13,23 +24,46 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
 
 // ============================================================================
 // RenderDoc Debug Markers
 // ============================================================================
-// 用于在 RenderDoc 中显示渲染事件层级
+// 用于在 RenderDoc 中显示渲染事件层级；每个分组同时是一个 GPU 计时作用域和一个 CPU 区段
+
+static PortalProfiler::GpuTimer g_GpuTimer;
+static const char* g_TracePath = nullptr;      // 捕获结束后写入的 Chrome trace 文件
+static uint64_t g_TraceStartNs = 0;            // 捕获开始时的 CPU 时钟
+
 void PushDebugGroup(const char* name) {
+    PortalProfiler::BeginCpuZone(name);
     if (glPushDebugGroup) {
         glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
     }
+    g_GpuTimer.Push(name);
 }
 
 void PopDebugGroup() {
+    g_GpuTimer.Pop();
     if (glPopDebugGroup) {
         glPopDebugGroup();
     }
+    PortalProfiler::EndCpuZone();
 }
 
+// 作用域内的调试分组：一个宏同时产生 GL 标记、GPU 计时和 CPU 区段
+struct DebugGroupScope {
+    explicit DebugGroupScope(const char* name) { PushDebugGroup(name); }
+    ~DebugGroupScope() { PopDebugGroup(); }
+    DebugGroupScope(const DebugGroupScope&) = delete;
+    DebugGroupScope& operator=(const DebugGroupScope&) = delete;
+};
+
+#define PORTAL_PROFILE_GROUP(name) DebugGroupScope PORTAL_PROFILER_JOIN(debugGroup, __LINE__)(name)
+
 // 带格式化的调试组
 void PushDebugGroupF(const char* format, int value) {
     char buffer[256];
@@ -40,6 +74,12 @@ void PushDebugGroupF(const char* format, int value) {
 const int WINDOW_WIDTH = 1280;
 const int WINDOW_HEIGHT = 720;
 
+// 主视图渲染到的帧缓冲：窗口模式为 0，无头模式为离屏 FBO
+static GLuint g_BackbufferFBO = 0;
+// 该帧缓冲的像素尺寸（视口、裁剪矩形用）；HiDPI 显示器上大于窗口尺寸，窗口模式每帧读取
+static int g_FramebufferWidth = WINDOW_WIDTH;
+static int g_FramebufferHeight = WINDOW_HEIGHT;
+
 std::vector<PortalRenderer::Portal*> g_Portals;
 PortalTeleporter::TeleportableEntity g_Player;
 glm::vec3 g_CameraPosition(0.0f, 1.7f, 5.0f);
@@ -48,25 +88,28 @@ float g_CameraPitch = 0.0f;
 
 const float PORTAL_WIDTH = 2.0f;
 const float PORTAL_HEIGHT = 3.0f;
+const float PORTAL_FRAME_THICKNESS = 0.15f;
 
 // Scene shader for demo
-static GLuint g_SceneShader = 0;
+// 所有着色器源码不含 #version，由 PortalGL::ShaderProgram 拼接版本行和 ViewBlock
+static PortalGL::ShaderProgram g_SceneProgram;
 static GLuint g_CubeVAO = 0;
 
+// 每视图 uniform 缓冲：每帧每个视图写入一次
+static PortalGL::UniformRing g_ViewUniforms;
+
 const char* SCENE_VS = R"(
-#version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aColor;
-uniform mat4 uMVP;
+uniform mat4 uModel;
 out vec3 vColor;
 void main() {
-    gl_Position = uMVP * vec4(aPos, 1.0);
+    gl_Position = uViewProjection * uModel * vec4(aPos, 1.0);
     vColor = aColor;
 }
 )";
 
 const char* SCENE_FS = R"(
-#version 330 core
 in vec3 vColor;
 out vec4 FragColor;
 void main() {
@@ -78,22 +121,18 @@ void main() {
 // 天空盒着色器 - 带程序化云层
 // ============================================================================
 const char* SKYBOX_VS = R"(
-#version 330 core
 layout(location = 0) in vec3 aPos;
 out vec3 vTexCoord;
-uniform mat4 uViewProj;
 void main() {
     vTexCoord = aPos;
-    vec4 pos = uViewProj * vec4(aPos, 1.0);
+    vec4 pos = uSkyViewProjection * vec4(aPos, 1.0);
     gl_Position = pos.xyww;  // 保持z=w，确保天空盒始终在最远处
 }
 )";
 
 const char* SKYBOX_FS = R"(
-#version 330 core
 in vec3 vTexCoord;
 out vec4 FragColor;
-uniform float uTime;
 
 // 简单的噪声函数
 float hash(vec2 p) {
@@ -128,6 +167,8 @@ float fbm(vec2 p) {
 }
 
 void main() {
+    float uTime = uCameraPosTime.w;
+    
     // 标准化方向向量
     vec3 dir = normalize(vTexCoord);
     
@@ -208,19 +249,164 @@ void main() {
 }
 )";
 
+// 烘焙天空盒：直接采样立方体贴图
+const char* SKYBOX_BAKED_FS = R"(
+in vec3 vTexCoord;
+out vec4 FragColor;
+uniform samplerCube uSkyCubemap;
+void main() {
+    FragColor = texture(uSkyCubemap, vTexCoord);
+}
+)";
+
 // 天空盒全局变量
-static GLuint g_SkyboxShader = 0;
+static PortalGL::ShaderProgram g_SkyboxProgram;         // 实时计算（也用于烘焙立方体贴图）
+static PortalGL::ShaderProgram g_SkyboxBakedProgram;    // 采样烘焙结果
 static GLuint g_SkyboxVAO = 0;
 
+/**
+ * 天空盒模式
+ * Live：每个视图的每个天空像素都实时计算 fbm 云层
+ * Baked：天空先渲染到立方体贴图，所有视图只做一次纹理采样
+ */
+enum class SkyMode {
+    Live,
+    Baked
+};
+
+static SkyMode g_SkyMode = SkyMode::Baked;
+
+// 立方体贴图每面的分辨率
+const int SKY_CUBEMAP_SIZE = 256;
+// 立方体贴图绑定的纹理单元（0 号留给创建纹理时的临时绑定）
+const int SKY_CUBEMAP_TEXTURE_UNIT = 1;
+
+/**
+ * 分帧刷新的天空立方体贴图
+ *
+ * 双缓冲：视图采样 textures[front]，另一张每帧烘焙 facesPerFrame 个面，
+ * 六个面都使用同一个刷新周期开始时的时间，全部完成后交换，采样结果不会出现接缝。
+ */
+struct SkyCubemap {
+    GLuint fbo = 0;
+    GLuint textures[2] = { 0, 0 };
+    int front = 0;
+    int nextFace = 0;               // 后台贴图下一个要烘焙的面
+    float cycleTime = 0.0f;         // 本轮烘焙使用的时间
+    float lastCycleStart = -1.0f;
+    
+    // 刷新设置
+    int facesPerFrame = 1;          // 每帧烘焙的面数（1..6）
+    float refreshInterval = 0.0f;   // 两轮刷新开始之间的最小间隔（秒），0 = 连续刷新
+    
+    int facesBaked = 0;             // 本帧烘焙的面数（调试输出用）
+};
+
+static SkyCubemap g_SkyCubemap;
+
 // Scene geometry data
-static GLuint g_FloorVAO = 0;
-static GLuint g_WallVAO = 0;
-static GLuint g_BoxVAO = 0;
-static GLuint g_PillarVAO = 0;
-static int g_FloorVertCount = 0;
-static int g_WallVertCount = 0;
-static int g_BoxVertCount = 0;
-static int g_PillarVertCount = 0;
+// 场景物体：合并顶点缓冲中一段连续顶点及其世界空间包围盒（用于视锥剔除）
+struct SceneObject {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    PortalGeometry::MeshRange vertices;     // 在源顶点数组中的范围
+    PortalGeometry::MeshRange indices;      // 在索引缓冲中的范围（构建网格后填写）
+    bool tiledFloor = false;                // 棋盘格地板块（程序化地板模式下不绘制）
+};
+
+// 全部静态几何体（地板、墙、箱子、柱子）合并在一个索引化网格中
+struct SceneMesh {
+    PortalGeometry::StaticMesh mesh;
+    std::vector<SceneObject> objects;
+};
+
+// 与 GL 的 DrawElementsIndirectCommand 布局一致
+struct SceneDrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/**
+ * 一帧内所有视图的场景绘制命令
+ * 遍历结束后由工作线程按每个视图的裁剪体剔除生成，合并后统一上传一次，
+ * 每个视图提交时只发出一次多重绘制调用，调用数不随场景物体数量增长
+ */
+struct SceneDrawLists {
+    struct Range {
+        int first = 0;                  // 在 commands 中的起始下标
+        int count = 0;
+        bool floorVisible = false;      // 程序化地板与该视图的裁剪体相交
+        float nearestDepth = 0.0f;      // 最近可见物体到视图相机的距离（渲染队列排序用）
+        float floorDepth = 0.0f;        // 相机到地板平面的距离
+    };
+    // 剔除后按距离排序的可见物体（每个执行线程一份临时数组，见 DrawListScratch）
+    struct VisibleObject {
+        float depth;
+        int object;
+    };
+    std::vector<SceneDrawCommand> commands;
+    std::vector<Range> views;           // 按视图树节点索引
+    std::vector<const void*> offsets;   // glMultiDrawElements 回退路径的参数（与 commands 平行）
+    std::vector<GLsizei> counts;
+    GLuint indirectBuffer = 0;
+    size_t indirectCapacity = 0;        // 间接缓冲可容纳的命令数
+    bool useIndirect = false;           // GL 4.3 或 ARB_multi_draw_indirect 可用
+};
+
+static SceneMesh g_Scene;
+static SceneDrawLists g_SceneDraws;
+// 扇区图：物体按扇区分组（每个扇区一个 BVH），门户视图树的每个视图只提交可达扇区的物体
+static PortalSectors::SectorGraph g_Sectors;
+
+// 地板按 FLOOR_CHUNK_TILES × FLOOR_CHUNK_TILES 个格子分块，便于剔除
+const int FLOOR_CHUNK_TILES = 10;
+// 地板范围为 ±FLOOR_GRID_SIZE 个格子（100x100 单位），网格模式和程序化模式共用格子尺寸与颜色
+const int FLOOR_GRID_SIZE = 50;
+const float FLOOR_TILE_SIZE = 2.0f;
+const glm::vec3 FLOOR_COLOR_LIGHT(0.7f, 0.7f, 0.75f);
+const glm::vec3 FLOOR_COLOR_DARK(0.3f, 0.3f, 0.35f);
+
+/**
+ * 地板模式
+ * Tiled：每个格子一个带颜色的四边形（约 6 万个顶点，按块剔除）
+ * Procedural：整个地板一个四边形，片元着色器按世界坐标计算棋盘格
+ */
+enum class FloorMode {
+    Tiled,
+    Procedural
+};
+
+static FloorMode g_FloorMode = FloorMode::Procedural;
+static PortalGeometry::StaticMesh g_ProceduralFloorMesh;
+static PortalGL::ShaderProgram g_FloorProgram;
+
+const char* FLOOR_VS = R"(
+layout(location = 0) in vec3 aPos;
+uniform mat4 uModel;
+out vec3 vWorldPos;
+void main() {
+    vec4 worldPos = uModel * vec4(aPos, 1.0);
+    gl_Position = uViewProjection * worldPos;
+    vWorldPos = worldPos.xyz;
+}
+)";
+
+// 与网格模式一致：格子 (x, z) 在 x + z 为偶数时取浅色
+const char* FLOOR_FS = R"(
+in vec3 vWorldPos;
+out vec4 FragColor;
+uniform float uFloorTileSize;
+uniform vec3 uFloorColorLight;
+uniform vec3 uFloorColorDark;
+void main() {
+    ivec2 tile = ivec2(floor(vWorldPos.xz / uFloorTileSize));
+    bool light = ((tile.x + tile.y) & 1) == 0;
+    FragColor = vec4(light ? uFloorColorLight : uFloorColorDark, 1.0);
+}
+)";
 
 // Helper to create a colored quad
 void AddQuad(std::vector<float>& verts, 
@@ -267,19 +453,26 @@ void AddBox(std::vector<float>& verts, glm::vec3 center, glm::vec3 size, glm::ve
         c + glm::vec3(hx, -hy, hz), c + glm::vec3(-hx, -hy, hz), color * 0.7f);
 }
 
-GLuint CreateVAOFromVertices(const std::vector<float>& vertices) {
-    GLuint VAO, VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glBindVertexArray(0);
-    return VAO;
+// 构建索引化、量化的网格并上传，打印内存与顶点读取统计
+PortalGeometry::StaticMesh CreateStaticMesh(const char* name, const std::vector<float>& vertices) {
+    PortalGeometry::IndexedMesh mesh = PortalGeometry::BuildIndexedMesh(vertices);
+    PortalGeometry::PrintMeshStats(name, mesh.stats);
+    return PortalGeometry::UploadStaticMesh(mesh);
+}
+
+// 把 verts 中从 firstFloat 开始新追加的顶点登记为一个场景物体
+void RegisterSceneObject(std::vector<SceneObject>& objects, const std::vector<float>& verts, size_t firstFloat) {
+    SceneObject obj;
+    obj.vertices.first = (uint32_t)(firstFloat / 6);
+    obj.vertices.count = (uint32_t)((verts.size() - firstFloat) / 6);
+    obj.boundsMin = glm::vec3(verts[firstFloat], verts[firstFloat + 1], verts[firstFloat + 2]);
+    obj.boundsMax = obj.boundsMin;
+    for (size_t i = firstFloat; i < verts.size(); i += 6) {
+        glm::vec3 p(verts[i], verts[i + 1], verts[i + 2]);
+        obj.boundsMin = glm::min(obj.boundsMin, p);
+        obj.boundsMax = glm::max(obj.boundsMax, p);
+    }
+    objects.push_back(obj);
 }
 
 // Helper to add a double-sided quad (both front and back faces)
@@ -293,30 +486,38 @@ void AddDoubleSidedQuad(std::vector<float>& verts,
 }
 
 void CreateSceneGeometry() {
+    // 所有静态几何体写入同一个顶点数组，每个物体登记为其中一段
+    std::vector<float> sceneVerts;
+    
     // ============ FLOOR (Large checkered pattern) ============
+    // 网格模式的地板块；程序化模式的地板是单独的一个四边形（CreateProceduralFloor）
     {
-        std::vector<float> floorVerts;
-        float tileSize = 2.0f;
-        int gridSize = 50;  // 扩大地板范围：100x100单位
-        for (int x = -gridSize; x < gridSize; x++) {
-            for (int z = -gridSize; z < gridSize; z++) {
-                bool isWhite = ((x + z) % 2 == 0);
-                glm::vec3 color = isWhite ? glm::vec3(0.7f, 0.7f, 0.75f) : glm::vec3(0.3f, 0.3f, 0.35f);
-                glm::vec3 p0(x * tileSize, 0.0f, z * tileSize);
-                glm::vec3 p1((x + 1) * tileSize, 0.0f, z * tileSize);
-                glm::vec3 p2((x + 1) * tileSize, 0.0f, (z + 1) * tileSize);
-                glm::vec3 p3(x * tileSize, 0.0f, (z + 1) * tileSize);
-                // 使用逆时针顺序 (p0->p3->p2->p1) 让法线朝上 (+Y)
-                AddQuad(floorVerts, p0, p3, p2, p1, color);
+        float tileSize = FLOOR_TILE_SIZE;
+        int gridSize = FLOOR_GRID_SIZE;
+        // 按块生成，每块的顶点连续存放，作为一个可剔除的物体
+        for (int chunkX = -gridSize; chunkX < gridSize; chunkX += FLOOR_CHUNK_TILES) {
+            for (int chunkZ = -gridSize; chunkZ < gridSize; chunkZ += FLOOR_CHUNK_TILES) {
+                size_t chunkStart = sceneVerts.size();
+                for (int x = chunkX; x < glm::min(chunkX + FLOOR_CHUNK_TILES, gridSize); x++) {
+                    for (int z = chunkZ; z < glm::min(chunkZ + FLOOR_CHUNK_TILES, gridSize); z++) {
+                        bool isWhite = ((x + z) % 2 == 0);
+                        glm::vec3 color = isWhite ? FLOOR_COLOR_LIGHT : FLOOR_COLOR_DARK;
+                        glm::vec3 p0(x * tileSize, 0.0f, z * tileSize);
+                        glm::vec3 p1((x + 1) * tileSize, 0.0f, z * tileSize);
+                        glm::vec3 p2((x + 1) * tileSize, 0.0f, (z + 1) * tileSize);
+                        glm::vec3 p3(x * tileSize, 0.0f, (z + 1) * tileSize);
+                        // 使用逆时针顺序 (p0->p3->p2->p1) 让法线朝上 (+Y)
+                        AddQuad(sceneVerts, p0, p3, p2, p1, color);
+                    }
+                }
+                RegisterSceneObject(g_Scene.objects, sceneVerts, chunkStart);
+                g_Scene.objects.back().tiledFloor = true;
             }
         }
-        g_FloorVAO = CreateVAOFromVertices(floorVerts);
-        g_FloorVertCount = (int)floorVerts.size() / 6;
     }
     
     // ============ WALLS (Double-sided) ============
     {
-        std::vector<float> wallVerts;
         float wallHeight = 8.0f;
         float roomSize = 30.0f;
         glm::vec3 wallColor1(0.6f, 0.55f, 0.5f);
@@ -324,151 +525,342 @@ void CreateSceneGeometry() {
         glm::vec3 wallColor2(0.5f, 0.6f, 0.55f);
         glm::vec3 wallColor2Back(0.4f, 0.5f, 0.45f);  // 背面稍暗
         
+        // 每面墙登记为一个场景物体
+        auto addWall = [&](glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3,
+                           glm::vec3 colorFront, glm::vec3 colorBack) {
+            size_t start = sceneVerts.size();
+            AddDoubleSidedQuad(sceneVerts, p0, p1, p2, p3, colorFront, colorBack);
+            RegisterSceneObject(g_Scene.objects, sceneVerts, start);
+        };
+        
         // Room A walls (around portal A at -5, 1.5, 0)
         // Back wall - 双面
-        AddDoubleSidedQuad(wallVerts,
+        addWall(
             glm::vec3(-roomSize, 0, -15), glm::vec3(-2, 0, -15),
             glm::vec3(-2, wallHeight, -15), glm::vec3(-roomSize, wallHeight, -15), 
             wallColor1, wallColor1Back);
         // Left wall - 双面
-        AddDoubleSidedQuad(wallVerts,
+        addWall(
             glm::vec3(-roomSize, 0, 15), glm::vec3(-roomSize, 0, -15),
             glm::vec3(-roomSize, wallHeight, -15), glm::vec3(-roomSize, wallHeight, 15), 
             wallColor1 * 0.9f, wallColor1Back * 0.9f);
         // Front wall (with opening) - 双面
-        AddDoubleSidedQuad(wallVerts,
+        addWall(
             glm::vec3(-2, 0, 15), glm::vec3(-roomSize, 0, 15),
             glm::vec3(-roomSize, wallHeight, 15), glm::vec3(-2, wallHeight, 15), 
             wallColor1 * 0.85f, wallColor1Back * 0.85f);
             
         // Room B walls (around portal B at 5, 1.5, -10)
         // Back wall - 双面
-        AddDoubleSidedQuad(wallVerts,
+        addWall(
             glm::vec3(2, 0, -roomSize), glm::vec3(roomSize, 0, -roomSize),
             glm::vec3(roomSize, wallHeight, -roomSize), glm::vec3(2, wallHeight, -roomSize), 
             wallColor2, wallColor2Back);
         // Right wall - 双面
-        AddDoubleSidedQuad(wallVerts,
+        addWall(
             glm::vec3(roomSize, 0, -roomSize), glm::vec3(roomSize, 0, -5),
             glm::vec3(roomSize, wallHeight, -5), glm::vec3(roomSize, wallHeight, -roomSize), 
             wallColor2 * 0.9f, wallColor2Back * 0.9f);
         // Side wall - 双面
-        AddDoubleSidedQuad(wallVerts,
+        addWall(
             glm::vec3(2, 0, -5), glm::vec3(2, 0, -roomSize),
             glm::vec3(2, wallHeight, -roomSize), glm::vec3(2, wallHeight, -5), 
             wallColor2 * 0.85f, wallColor2Back * 0.85f);
-        
-        g_WallVAO = CreateVAOFromVertices(wallVerts);
-        g_WallVertCount = (int)wallVerts.size() / 6;
     }
     
     // ============ DECORATIVE BOXES ============
     {
-        std::vector<float> boxVerts;
+        auto addBox = [&](glm::vec3 center, glm::vec3 size, glm::vec3 color) {
+            size_t start = sceneVerts.size();
+            AddBox(sceneVerts, center, size, color);
+            RegisterSceneObject(g_Scene.objects, sceneVerts, start);
+        };
         
         // Room A decorations (blue/cyan themed)
-        AddBox(boxVerts, glm::vec3(-8, 0.5f, -5), glm::vec3(1, 1, 1), glm::vec3(0.2f, 0.5f, 0.8f));
-        AddBox(boxVerts, glm::vec3(-10, 0.75f, 3), glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.3f, 0.6f, 0.9f));
-        AddBox(boxVerts, glm::vec3(-12, 1.0f, -8), glm::vec3(2, 2, 2), glm::vec3(0.1f, 0.4f, 0.7f));
-        AddBox(boxVerts, glm::vec3(-6, 0.4f, 8), glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3(0.4f, 0.7f, 1.0f));
+        addBox(glm::vec3(-8, 0.5f, -5), glm::vec3(1, 1, 1), glm::vec3(0.2f, 0.5f, 0.8f));
+        addBox(glm::vec3(-10, 0.75f, 3), glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.3f, 0.6f, 0.9f));
+        addBox(glm::vec3(-12, 1.0f, -8), glm::vec3(2, 2, 2), glm::vec3(0.1f, 0.4f, 0.7f));
+        addBox(glm::vec3(-6, 0.4f, 8), glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3(0.4f, 0.7f, 1.0f));
         // Stacked boxes
-        AddBox(boxVerts, glm::vec3(-15, 0.5f, 0), glm::vec3(1, 1, 1), glm::vec3(0.25f, 0.55f, 0.85f));
-        AddBox(boxVerts, glm::vec3(-15, 1.5f, 0), glm::vec3(0.8f, 1, 0.8f), glm::vec3(0.3f, 0.6f, 0.9f));
-        AddBox(boxVerts, glm::vec3(-15, 2.4f, 0), glm::vec3(0.6f, 0.8f, 0.6f), glm::vec3(0.35f, 0.65f, 0.95f));
+        addBox(glm::vec3(-15, 0.5f, 0), glm::vec3(1, 1, 1), glm::vec3(0.25f, 0.55f, 0.85f));
+        addBox(glm::vec3(-15, 1.5f, 0), glm::vec3(0.8f, 1, 0.8f), glm::vec3(0.3f, 0.6f, 0.9f));
+        addBox(glm::vec3(-15, 2.4f, 0), glm::vec3(0.6f, 0.8f, 0.6f), glm::vec3(0.35f, 0.65f, 0.95f));
         
         // Room B decorations (orange/red themed)
-        AddBox(boxVerts, glm::vec3(8, 0.5f, -12), glm::vec3(1, 1, 1), glm::vec3(0.9f, 0.4f, 0.2f));
-        AddBox(boxVerts, glm::vec3(12, 0.75f, -15), glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.95f, 0.5f, 0.25f));
-        AddBox(boxVerts, glm::vec3(15, 1.0f, -20), glm::vec3(2, 2, 2), glm::vec3(0.85f, 0.35f, 0.15f));
-        AddBox(boxVerts, glm::vec3(6, 0.4f, -18), glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3(1.0f, 0.55f, 0.3f));
+        addBox(glm::vec3(8, 0.5f, -12), glm::vec3(1, 1, 1), glm::vec3(0.9f, 0.4f, 0.2f));
+        addBox(glm::vec3(12, 0.75f, -15), glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.95f, 0.5f, 0.25f));
+        addBox(glm::vec3(15, 1.0f, -20), glm::vec3(2, 2, 2), glm::vec3(0.85f, 0.35f, 0.15f));
+        addBox(glm::vec3(6, 0.4f, -18), glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3(1.0f, 0.55f, 0.3f));
         // Stacked boxes
-        AddBox(boxVerts, glm::vec3(20, 0.5f, -15), glm::vec3(1, 1, 1), glm::vec3(0.9f, 0.45f, 0.2f));
-        AddBox(boxVerts, glm::vec3(20, 1.5f, -15), glm::vec3(0.8f, 1, 0.8f), glm::vec3(0.95f, 0.5f, 0.25f));
-        AddBox(boxVerts, glm::vec3(20, 2.4f, -15), glm::vec3(0.6f, 0.8f, 0.6f), glm::vec3(1.0f, 0.55f, 0.3f));
+        addBox(glm::vec3(20, 0.5f, -15), glm::vec3(1, 1, 1), glm::vec3(0.9f, 0.45f, 0.2f));
+        addBox(glm::vec3(20, 1.5f, -15), glm::vec3(0.8f, 1, 0.8f), glm::vec3(0.95f, 0.5f, 0.25f));
+        addBox(glm::vec3(20, 2.4f, -15), glm::vec3(0.6f, 0.8f, 0.6f), glm::vec3(1.0f, 0.55f, 0.3f));
         
         // Central area (green themed)
-        AddBox(boxVerts, glm::vec3(0, 0.6f, 5), glm::vec3(1.2f, 1.2f, 1.2f), glm::vec3(0.3f, 0.7f, 0.3f));
-        AddBox(boxVerts, glm::vec3(3, 0.5f, 3), glm::vec3(1, 1, 1), glm::vec3(0.35f, 0.75f, 0.35f));
-        
-        g_BoxVAO = CreateVAOFromVertices(boxVerts);
-        g_BoxVertCount = (int)boxVerts.size() / 6;
+        addBox(glm::vec3(0, 0.6f, 5), glm::vec3(1.2f, 1.2f, 1.2f), glm::vec3(0.3f, 0.7f, 0.3f));
+        addBox(glm::vec3(3, 0.5f, 3), glm::vec3(1, 1, 1), glm::vec3(0.35f, 0.75f, 0.35f));
     }
     
     // ============ PILLARS ============
     {
-        std::vector<float> pillarVerts;
         glm::vec3 pillarColor(0.65f, 0.6f, 0.55f);
+        auto addPillar = [&](glm::vec3 center, glm::vec3 size, glm::vec3 color) {
+            size_t start = sceneVerts.size();
+            AddBox(sceneVerts, center, size, color);
+            RegisterSceneObject(g_Scene.objects, sceneVerts, start);
+        };
         
         // Room A pillars
-        AddBox(pillarVerts, glm::vec3(-20, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor);
-        AddBox(pillarVerts, glm::vec3(-20, 4, 10), glm::vec3(1.5f, 8, 1.5f), pillarColor);
-        AddBox(pillarVerts, glm::vec3(-10, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
-        AddBox(pillarVerts, glm::vec3(-10, 4, 10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
+        addPillar(glm::vec3(-20, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor);
+        addPillar(glm::vec3(-20, 4, 10), glm::vec3(1.5f, 8, 1.5f), pillarColor);
+        addPillar(glm::vec3(-10, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
+        addPillar(glm::vec3(-10, 4, 10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
         
         // Room B pillars
-        AddBox(pillarVerts, glm::vec3(10, 4, -25), glm::vec3(1.5f, 8, 1.5f), pillarColor);
-        AddBox(pillarVerts, glm::vec3(25, 4, -25), glm::vec3(1.5f, 8, 1.5f), pillarColor);
-        AddBox(pillarVerts, glm::vec3(10, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
-        AddBox(pillarVerts, glm::vec3(25, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
-        
-        g_PillarVAO = CreateVAOFromVertices(pillarVerts);
-        g_PillarVertCount = (int)pillarVerts.size() / 6;
+        addPillar(glm::vec3(10, 4, -25), glm::vec3(1.5f, 8, 1.5f), pillarColor);
+        addPillar(glm::vec3(25, 4, -25), glm::vec3(1.5f, 8, 1.5f), pillarColor);
+        addPillar(glm::vec3(10, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
+        addPillar(glm::vec3(25, 4, -10), glm::vec3(1.5f, 8, 1.5f), pillarColor * 0.95f);
     }
     
+    // 每个物体独立去重和重排，得到它在索引缓冲中的范围
+    std::vector<PortalGeometry::MeshRange> objectRanges;
+    for (const SceneObject& obj : g_Scene.objects) objectRanges.push_back(obj.vertices);
+    PortalGeometry::IndexedMesh sceneMesh = PortalGeometry::BuildIndexedMesh(sceneVerts, objectRanges);
+    for (size_t i = 0; i < g_Scene.objects.size(); i++) g_Scene.objects[i].indices = sceneMesh.ranges[i];
+    PortalGeometry::PrintMeshStats("scene", sceneMesh.stats);
+    g_Scene.mesh = PortalGeometry::UploadStaticMesh(sceneMesh);
+    
     // Keep original simple VAO for compatibility
-    g_CubeVAO = g_BoxVAO;
+    g_CubeVAO = g_Scene.mesh.vao;
+    
+    // 间接绘制需要 GL 4.3 或 ARB_multi_draw_indirect，否则回退到 glMultiDrawElements（GL 3.3）
+    g_SceneDraws.useIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+    if (g_SceneDraws.useIndirect) {
+        glGenBuffers(1, &g_SceneDraws.indirectBuffer);
+    }
+    PORTAL_LOG(General, Info, "Scene: %zu objects, %s", g_Scene.objects.size(),
+               g_SceneDraws.useIndirect ? "glMultiDrawElementsIndirect" : "glMultiDrawElements");
 }
 
-void RenderScene(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
-    glUseProgram(g_SceneShader);
-    glm::mat4 mvp = projectionMatrix * viewMatrix;
-    glUniformMatrix4fv(glGetUniformLocation(g_SceneShader, "uMVP"), 1, GL_FALSE, glm::value_ptr(mvp));
-    
-    // Draw floor
-    glBindVertexArray(g_FloorVAO);
-    glDrawArrays(GL_TRIANGLES, 0, g_FloorVertCount);
-    
-    // Draw walls
-    glBindVertexArray(g_WallVAO);
-    glDrawArrays(GL_TRIANGLES, 0, g_WallVertCount);
+// 程序化地板：覆盖整个地板范围的一个四边形 + 计算棋盘格的着色器
+void CreateProceduralFloor() {
+    float extent = FLOOR_GRID_SIZE * FLOOR_TILE_SIZE;
+    std::vector<float> floorVerts;
+    // 与网格模式相同的逆时针顺序，法线朝上 (+Y)
+    AddQuad(floorVerts,
+        glm::vec3(-extent, 0.0f, -extent), glm::vec3(-extent, 0.0f, extent),
+        glm::vec3(extent, 0.0f, extent), glm::vec3(extent, 0.0f, -extent), FLOOR_COLOR_LIGHT);
+    g_ProceduralFloorMesh = CreateStaticMesh("procedural floor", floorVerts);
+    
+    g_FloorProgram.Build("floor", FLOOR_VS, FLOOR_FS);
+    PortalGL::GetStateCache().UseProgram(g_FloorProgram.id);
+    glUniform1f(g_FloorProgram[PortalGL::UNIFORM_FLOOR_TILE_SIZE], FLOOR_TILE_SIZE);
+    glUniform3fv(g_FloorProgram[PortalGL::UNIFORM_FLOOR_COLOR_LIGHT], 1, glm::value_ptr(FLOOR_COLOR_LIGHT));
+    glUniform3fv(g_FloorProgram[PortalGL::UNIFORM_FLOOR_COLOR_DARK], 1, glm::value_ptr(FLOOR_COLOR_DARK));
+}
+
+void SetFloorMode(FloorMode mode) {
+    g_FloorMode = mode;
+    PORTAL_LOG(General, Info, "Floor mode: %s", mode == FloorMode::Procedural ? "Procedural" : "Tiled");
+}
+
+// 点到包围盒的最近距离（点在盒内时为0）
+float DistanceToAABB(const glm::vec3& point, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    return glm::length(point - glm::clamp(point, boundsMin, boundsMax));
+}
+
+// 为一个视图生成可达扇区中与裁剪体相交的物体的绘制命令（只读场景数据，可在工作线程上执行）
+// visits: 该视图的扇区遍历结果，每个扇区的 BVH 只用到达它时的裁剪体查询
+// objectStamps/stamp: 去重标记（跨边界的物体属于多个扇区，同一扇区也可能经多条路径到达）
+// 可见物体按到相机的距离由近到远排列，排序后仍在索引缓冲中相邻的物体合并为一条命令
+// range.first 由合并各视图命令时填写
+void BuildViewSceneCommands(std::vector<SceneDrawCommand>& commands, SceneDrawLists::Range& range,
+                            std::vector<SceneDrawLists::VisibleObject>& visible,
+                            std::vector<uint32_t>& objectStamps, uint32_t stamp,
+                            const PortalSectors::CellVisit* visits, int visitCount, const glm::vec3& cameraPos) {
+    commands.clear();
+    range = SceneDrawLists::Range();
+    
+    // 程序化地板只有一个四边形：任一可达扇区的地板部分与其裁剪体相交即绘制
+    bool procedural = g_FloorMode == FloorMode::Procedural;
+    if (procedural) {
+        float extent = FLOOR_GRID_SIZE * FLOOR_TILE_SIZE;
+        for (int v = 0; v < visitCount && !range.floorVisible; v++) {
+            const PortalSectors::Cell& cell = g_Sectors.cells[visits[v].cell];
+            glm::vec3 floorMin(-extent, 0.0f, -extent), floorMax(extent, 0.0f, extent);
+            if (cell.bounded) {
+                floorMin = glm::max(floorMin, glm::vec3(cell.boundsMin.x, 0.0f, cell.boundsMin.z));
+                floorMax = glm::min(floorMax, glm::vec3(cell.boundsMax.x, 0.0f, cell.boundsMax.z));
+            }
+            range.floorVisible = PortalCulling::IntersectsAABB(visits[v].frustum, floorMin, floorMax);
+        }
+        range.floorDepth = glm::abs(cameraPos.y);
+    }
     
-    // Draw boxes
-    glBindVertexArray(g_BoxVAO);
-    glDrawArrays(GL_TRIANGLES, 0, g_BoxVertCount);
+    // 门户视图的裁剪体包含出口门户平面（近平面），门户背后的整棵子树在遍历中被剔除
+    visible.clear();
+    objectStamps.resize(g_Scene.objects.size(), 0);
+    for (int v = 0; v < visitCount; v++) {
+        const PortalSectors::Cell& cell = g_Sectors.cells[visits[v].cell];
+        cell.bvh.Query(visits[v].frustum, [&](int local) {
+            int i = cell.objects[local];
+            const SceneObject& obj = g_Scene.objects[i];
+            if (objectStamps[i] == stamp || (procedural && obj.tiledFloor)) return;
+            objectStamps[i] = stamp;
+            visible.push_back({ DistanceToAABB(cameraPos, obj.boundsMin, obj.boundsMax), i });
+        });
+    }
+    std::sort(visible.begin(), visible.end(),
+              [](const SceneDrawLists::VisibleObject& a, const SceneDrawLists::VisibleObject& b) {
+                  return a.depth < b.depth;
+              });
+    if (!visible.empty()) range.nearestDepth = visible.front().depth;
+    
+    SceneDrawCommand run = { 0, 1, 0, 0, 0 };
+    for (const SceneDrawLists::VisibleObject& object : visible) {
+        const SceneObject& obj = g_Scene.objects[object.object];
+        if (run.count > 0 && run.firstIndex + run.count == obj.indices.first) {
+            run.count += obj.indices.count;
+            continue;
+        }
+        if (run.count > 0) commands.push_back(run);
+        run.firstIndex = obj.indices.first;
+        run.count = obj.indices.count;
+    }
+    if (run.count > 0) commands.push_back(run);
     
-    // Draw pillars
-    glBindVertexArray(g_PillarVAO);
-    glDrawArrays(GL_TRIANGLES, 0, g_PillarVertCount);
+    range.count = (int)commands.size();
+}
+
+// 上传本帧全部视图的绘制命令（间接缓冲每帧孤立，容量不足时按两倍扩容）
+void UploadSceneDrawCommands(SceneDrawLists& lists) {
+    if (!lists.useIndirect) {
+        lists.offsets.clear();
+        lists.counts.clear();
+        for (const SceneDrawCommand& cmd : lists.commands) {
+            lists.offsets.push_back((const void*)((size_t)cmd.firstIndex * g_Scene.mesh.indexSize));
+            lists.counts.push_back((GLsizei)cmd.count);
+        }
+        return;
+    }
     
-    glBindVertexArray(0);
+    // 间接缓冲绑定不属于 VAO 状态，只有场景绘制使用，绑定后保持不变
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, lists.indirectBuffer);
+    if (lists.commands.size() > lists.indirectCapacity) {
+        lists.indirectCapacity = glm::max(lists.commands.size(), lists.indirectCapacity * 2);
+    }
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, lists.indirectCapacity * sizeof(SceneDrawCommand), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, lists.commands.size() * sizeof(SceneDrawCommand), lists.commands.data());
+}
+
+// 程序化地板：一个四边形，棋盘格由片元着色器计算（视图矩阵来自当前绑定的 ViewBlock）
+void RenderProceduralFloor() {
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    state.UseProgram(g_FloorProgram.id);
+    glUniformMatrix4fv(g_FloorProgram[PortalGL::UNIFORM_MODEL], 1, GL_FALSE,
+                       glm::value_ptr(g_ProceduralFloorMesh.dequantize));
+    g_ProceduralFloorMesh.Draw();
+}
+
+// 视图矩阵来自当前绑定的 ViewBlock
+// viewIndex: 视图树节点索引，可见物体已在 BuildSceneDrawLists 中按该视图的裁剪体剔除并由近到远排序
+void RenderScene(int viewIndex) {
+    const SceneDrawLists::Range& range = g_SceneDraws.views[viewIndex];
+    if (range.count == 0) return;
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    
+    state.UseProgram(g_SceneProgram.id);
+    // 场景在世界空间，模型矩阵只有反量化
+    const PortalGeometry::StaticMesh& mesh = g_Scene.mesh;
+    glUniformMatrix4fv(g_SceneProgram[PortalGL::UNIFORM_MODEL], 1, GL_FALSE, glm::value_ptr(mesh.dequantize));
+    
+    // 地板、墙、箱子、柱子在同一个缓冲中，整个视图只发出一次绘制调用
+    state.BindVertexArray(mesh.vao);
+    if (g_SceneDraws.useIndirect) {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, mesh.indexType,
+                                    (const void*)(range.first * sizeof(SceneDrawCommand)), range.count, 0);
+    } else {
+        glMultiDrawElements(GL_TRIANGLES, &g_SceneDraws.counts[range.first], mesh.indexType,
+                            &g_SceneDraws.offsets[range.first], range.count);
+    }
+}
+
+// ============================================================================
+// 门框实例化：每个门户一个实例（模型矩阵 + 颜色），每个视图一次实例化绘制
+// 实例数据和各视图的可见门框下标都放在缓冲纹理中，顶点着色器按 gl_InstanceID 间接取实例：
+// 只为可见门框运行顶点着色器，门户数量也不受实例掩码位数的限制
+// ============================================================================
+
+// 每个实例在缓冲纹理中占 5 个 RGBA32F 纹素（模型矩阵 4 列 + 颜色），与 PortalFrameInstance 布局一致
+const int PORTAL_FRAME_INSTANCE_TEXELS = 5;
+// 门框实例和可见门框下标绑定的纹理单元（1 号为天空立方体贴图）
+const int PORTAL_FRAME_INSTANCE_TEXTURE_UNIT = 2;
+const int PORTAL_FRAME_INDEX_TEXTURE_UNIT = 3;
+
+const glm::vec3 PORTAL_FRAME_COLOR_A(0.1f, 0.5f, 1.0f);  // Blue portal
+const glm::vec3 PORTAL_FRAME_COLOR_B(1.0f, 0.5f, 0.1f);  // Orange portal
+
+// 逐实例数据，下标与 g_Portals 一致
+struct PortalFrameInstance {
+    glm::mat4 model;    // 门户变换 × 反量化
+    glm::vec4 color;
+};
+
+struct PortalFrameInstances {
+    std::vector<PortalFrameInstance> instances;
+    std::vector<glm::vec3> colors;          // 门框颜色（SetupPortals 中按门户登记）
+    std::vector<glm::vec3> boundsMin;       // 世界空间包围盒（每帧随门户变换更新）
+    std::vector<glm::vec3> boundsMax;
+    std::unordered_map<const PortalRenderer::Portal*, uint32_t> indexOf;    // 门户 → 实例下标
+    std::vector<uint32_t> pairIndex;        // 链接门户的实例下标（无链接时为自身）
+    std::vector<uint32_t> visibleIndices;   // 全部视图的可见门框下标，按视图树顺序拼接
+    GLuint instanceBuffer = 0;              // 缓冲纹理的存储，按门户数量每帧重新分配
+    GLuint instanceTexture = 0;
+    GLuint indexBuffer = 0;
+    GLuint indexTexture = 0;
+};
+
+static PortalFrameInstances g_PortalFrames;
+static PortalGL::ShaderProgram g_PortalFrameProgram;
+
+// 门户 → 实例下标和链接门户下标；增删门户或改变链接后须重新调用（每帧只读）
+void UpdatePortalFrameLinks() {
+    PortalFrameInstances& frames = g_PortalFrames;
+    frames.indexOf.clear();
+    for (size_t i = 0; i < g_Portals.size(); i++) frames.indexOf[g_Portals[i]] = (uint32_t)i;
+    frames.pairIndex.resize(g_Portals.size());
+    for (size_t i = 0; i < g_Portals.size(); i++) {
+        auto it = frames.indexOf.find(g_Portals[i]->linkedPortal);
+        frames.pairIndex[i] = it != frames.indexOf.end() ? it->second : (uint32_t)i;
+    }
 }
 
 void SetupPortals() {
+    // 模板路径直接在主帧缓冲上绘制门户视图，门户表面用 g_PortalSurfaceMesh：
+    // 不需要 PortalRenderer 的共享资源（只有 RenderPortals 使用）
+    
     // 创建门户A - 位于玩家初始位置的左前方
     // 门户正面朝向 +Z（朝向玩家）
     PortalRenderer::Portal* portalA = new PortalRenderer::Portal();
-    portalA->transform = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f, 1.5f, 0.0f));
+    glm::mat4 transformA = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f, 1.5f, 0.0f));
     // 旋转使门户正面朝向 +Z（朝向玩家初始位置方向）
-    portalA->transform = glm::rotate(portalA->transform, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    transformA = glm::rotate(transformA, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    portalA->SetTransform(transformA);
     portalA->width = PORTAL_WIDTH;
     portalA->height = PORTAL_HEIGHT;
     portalA->isActive = true;
-    PortalRenderer::CreatePortalMesh(portalA);
-    PortalRenderer::CreatePortalRenderTarget(portalA, WINDOW_WIDTH, WINDOW_HEIGHT);
-    portalA->shaderProgram = PortalRenderer::CompilePortalShader();
     
     // 创建门户B - 位于另一个区域
     // 门户正面朝向 -X 方向（旋转90度后）
     PortalRenderer::Portal* portalB = new PortalRenderer::Portal();
-    portalB->transform = glm::translate(glm::mat4(1.0f), glm::vec3(5.0f, 1.5f, -10.0f));
+    glm::mat4 transformB = glm::translate(glm::mat4(1.0f), glm::vec3(5.0f, 1.5f, -10.0f));
     // 旋转使门户正面朝向 -X 方向
-    portalB->transform = glm::rotate(portalB->transform, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    transformB = glm::rotate(transformB, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    portalB->SetTransform(transformB);
     portalB->width = PORTAL_WIDTH;
     portalB->height = PORTAL_HEIGHT;
     portalB->isActive = true;
-    PortalRenderer::CreatePortalMesh(portalB);
-    PortalRenderer::CreatePortalRenderTarget(portalB, WINDOW_WIDTH, WINDOW_HEIGHT);
-    portalB->shaderProgram = PortalRenderer::CompilePortalShader();
     
     // 链接门户
     portalA->linkedPortal = portalB;
@@ -476,6 +868,108 @@ void SetupPortals() {
     
     g_Portals.push_back(portalA);
     g_Portals.push_back(portalB);
+    g_PortalFrames.colors.push_back(PORTAL_FRAME_COLOR_A);
+    g_PortalFrames.colors.push_back(PORTAL_FRAME_COLOR_B);
+    UpdatePortalFrameLinks();
+    
+    // GetLink 第一次调用时会写入门户的链接缓存：在模拟线程启动前建好，
+    // 之后两个线程调用 GetLink 都只读缓存
+    for (PortalRenderer::Portal* portal : g_Portals) {
+        if (portal->linkedPortal) portal->GetLink();
+    }
+}
+
+// 扇区图：两个三面围墙的房间和其余的户外空间
+// 房间敞开的一面和没有屋顶的上方是通往户外的开口；房间区域向下延伸到地板以下，
+// 放在地板上的物体被房间严格包含，只属于房间
+void SetupSectors() {
+    const float wallHeight = 8.0f;
+    int outside = g_Sectors.AddOutsideCell("outside");
+    int roomA = g_Sectors.AddCell("room A", glm::vec3(-30.0f, -1.0f, -15.0f), glm::vec3(-2.0f, wallHeight, 15.0f));
+    int roomB = g_Sectors.AddCell("room B", glm::vec3(2.0f, -1.0f, -30.0f), glm::vec3(30.0f, wallHeight, -5.0f));
+    
+    // 开口法线指向户外（front）
+    // 房间 A 朝 +X 敞开，房间 B 朝 +Z 敞开
+    g_Sectors.AddOpening(outside, roomA, PortalSectors::MakeRectangle(
+        glm::vec3(-2.0f, -1.0f, -15.0f), glm::vec3(0.0f, wallHeight + 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 30.0f)));
+    g_Sectors.AddOpening(outside, roomB, PortalSectors::MakeRectangle(
+        glm::vec3(2.0f, -1.0f, -5.0f), glm::vec3(28.0f, 0.0f, 0.0f), glm::vec3(0.0f, wallHeight + 1.0f, 0.0f)));
+    // 屋顶
+    g_Sectors.AddOpening(outside, roomA, PortalSectors::MakeRectangle(
+        glm::vec3(-30.0f, wallHeight, -15.0f), glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(28.0f, 0.0f, 0.0f)));
+    g_Sectors.AddOpening(outside, roomB, PortalSectors::MakeRectangle(
+        glm::vec3(2.0f, wallHeight, -30.0f), glm::vec3(0.0f, 0.0f, 25.0f), glm::vec3(28.0f, 0.0f, 0.0f)));
+    
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    for (const SceneObject& obj : g_Scene.objects) {
+        boundsMin.push_back(obj.boundsMin);
+        boundsMax.push_back(obj.boundsMax);
+    }
+    g_Sectors.AssignObjects(boundsMin, boundsMax);
+    
+    for (PortalRenderer::Portal* portal : g_Portals) {
+        portal->cell = g_Sectors.Locate(portal->GetPosition());
+    }
+    for (const PortalSectors::Cell& cell : g_Sectors.cells) {
+        PORTAL_LOG(General, Info, "Sector '%s': %zu objects, %zu BVH nodes, %zu openings", cell.name.c_str(),
+                   cell.objects.size(), cell.bvh.nodes.size(), cell.openings.size());
+    }
+}
+
+// ============================================================================
+// 模拟线程
+// ============================================================================
+// 玩家移动和传送检测在模拟线程上以固定频率运行，传送结果与渲染帧率无关；
+// 渲染线程每帧取最新快照，在上一 tick 和当前 tick 之间插值出相机
+// g_Portals 由模拟线程和渲染线程共享，不加锁：门户在 SetupPortals 之后不再移动、不再重新链接，
+// 链接缓存（Portal::GetLink）在 SetupPortals 末尾建好，此后不会失效。
+// 模拟线程运行期间修改门户变换或 linkedPortal 会让两个线程同时重建缓存，须先停止模拟线程
+
+const double SIMULATION_TICK_RATE = 120.0;
+const float PLAYER_SPEED = 5.0f;
+const float MOUSE_SENSITIVITY = 0.1f;
+
+enum MoveKey : uint32_t {
+    MOVE_FORWARD = 1u << 0,
+    MOVE_BACK = 1u << 1,
+    MOVE_LEFT = 1u << 2,
+    MOVE_RIGHT = 1u << 3
+};
+
+// 主线程采样的输入，模拟线程每个 tick 取走
+struct PlayerInput {
+    uint32_t moveKeys = 0;      // MoveKey 位掩码（当前按住的键）
+    float yawDelta = 0.0f;      // 自上次取走以来累积的鼠标增量（度）
+    float pitchDelta = 0.0f;
+};
+
+struct CameraState {
+    glm::vec3 position = glm::vec3(0.0f);
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+};
+
+// 模拟线程发布给渲染线程的不可变快照
+struct WorldSnapshot {
+    uint64_t tick = 0;
+    uint64_t publishNs = 0;     // 发布时的 steady_clock 时间
+    CameraState previous;       // 上一 tick；本 tick 发生传送时等于 current（不跨传送插值）
+    CameraState current;
+    uint32_t teleports = 0;     // 累计传送次数
+};
+
+static std::mutex g_InputMutex;
+static PlayerInput g_PendingInput;                  // 受 g_InputMutex 保护
+static PortalSimulation::TripleBuffer<WorldSnapshot> g_WorldSnapshots;
+static PortalSimulation::FixedTickThread g_SimulationThread;
+
+// 以下状态在线程启动后只由模拟线程访问（无头模式下在渲染线程上同步推进）
+static CameraState g_SimCamera;
+static uint32_t g_SimTeleports = 0;
+
+static uint64_t SteadyNowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 void SetupPlayer() {
@@ -483,74 +977,183 @@ void SetupPlayer() {
     g_Player.previousPosition = g_CameraPosition;
     g_Player.velocity = glm::vec3(0.0f);
     g_Player.transform = glm::translate(glm::mat4(1.0f), g_CameraPosition);
+    
+    g_SimCamera.position = g_CameraPosition;
+    g_SimCamera.yaw = g_CameraYaw;
+    g_SimCamera.pitch = g_CameraPitch;
+    WorldSnapshot initial;
+    initial.previous = g_SimCamera;
+    initial.current = g_SimCamera;
+    g_WorldSnapshots.Reset(initial);
+}
+
+// 按住的移动键和鼠标增量推进一个 tick
+void ApplyPlayerInput(CameraState& camera, const PlayerInput& input, float deltaTime) {
+    camera.yaw += input.yawDelta;
+    camera.pitch = glm::clamp(camera.pitch + input.pitchDelta, -89.0f, 89.0f);
+    
+    float speed = PLAYER_SPEED * deltaTime;
+    glm::vec3 front;
+    front.x = cos(glm::radians(camera.yaw));
+    front.y = 0.0f;
+    front.z = sin(glm::radians(camera.yaw));
+    front = glm::normalize(front);
+    glm::vec3 right = glm::normalize(glm::cross(front, glm::vec3(0, 1, 0)));
+    
+    if (input.moveKeys & MOVE_FORWARD) camera.position += front * speed;
+    if (input.moveKeys & MOVE_BACK) camera.position -= front * speed;
+    if (input.moveKeys & MOVE_LEFT) camera.position -= right * speed;
+    if (input.moveKeys & MOVE_RIGHT) camera.position += right * speed;
 }
 
-void UpdatePlayer(float deltaTime, float currentTime) {
+// 传送检测：穿过门户时改写相机位置和朝向，返回是否发生传送
+bool UpdatePlayer(CameraState& camera, float currentTime) {
+    PORTAL_CPU_ZONE("Update Player");
     g_Player.previousPosition = g_Player.position;
-    g_Player.position = g_CameraPosition;
+    g_Player.position = camera.position;
     
     for (PortalRenderer::Portal* portal : g_Portals) {
         if (!portal->isActive || !portal->linkedPortal) continue;
         if (PortalTeleporter::ShouldTeleport(g_Player, portal, PORTAL_WIDTH / 2.0f, PORTAL_HEIGHT / 2.0f, currentTime)) {
             // 传送位置
             PortalTeleporter::TeleportEntity(g_Player, portal, portal->linkedPortal);
-            g_CameraPosition = g_Player.position;
+            camera.position = g_Player.position;
             
             // 传送相机朝向 - 计算新的Yaw角度
             // 当前视线方向
             glm::vec3 currentForward;
-            currentForward.x = cos(glm::radians(g_CameraYaw)) * cos(glm::radians(g_CameraPitch));
-            currentForward.y = sin(glm::radians(g_CameraPitch));
-            currentForward.z = sin(glm::radians(g_CameraYaw)) * cos(glm::radians(g_CameraPitch));
+            currentForward.x = cos(glm::radians(camera.yaw)) * cos(glm::radians(camera.pitch));
+            currentForward.y = sin(glm::radians(camera.pitch));
+            currentForward.z = sin(glm::radians(camera.yaw)) * cos(glm::radians(camera.pitch));
             currentForward = glm::normalize(currentForward);
             
             // 传送后的视线方向
-            glm::vec3 newForward = PortalMath::TeleportDirection(currentForward, portal->transform, portal->linkedPortal->transform);
+            glm::vec3 newForward = PortalMath::TeleportDirection(currentForward, portal->GetLink());
             
             // 从新方向计算Yaw和Pitch
-            g_CameraYaw = glm::degrees(atan2(newForward.z, newForward.x));
-            g_CameraPitch = glm::degrees(asin(glm::clamp(newForward.y, -1.0f, 1.0f)));
+            camera.yaw = glm::degrees(atan2(newForward.z, newForward.x));
+            camera.pitch = glm::degrees(asin(glm::clamp(newForward.y, -1.0f, 1.0f)));
             
-            std::cout << "Teleported! New position: (" << g_Player.position.x << ", " << g_Player.position.y << ", " << g_Player.position.z << ")" << std::endl;
-            std::cout << "New camera direction: Yaw=" << g_CameraYaw << ", Pitch=" << g_CameraPitch << std::endl;
-            break;
+            PORTAL_LOG(Teleport, Info, "Teleported! New position: (%g, %g, %g), yaw=%g, pitch=%g",
+                       g_Player.position.x, g_Player.position.y, g_Player.position.z, camera.yaw, camera.pitch);
+            return true;
         }
     }
+    return false;
+}
+
+// 模拟线程的一个 tick：取走输入、移动、传送检测，发布快照
+void SimulationTick(uint64_t tick, float deltaTime) {
+    PORTAL_CPU_ZONE("Simulation Tick");
+    PlayerInput input;
+    {
+        std::lock_guard<std::mutex> lock(g_InputMutex);
+        input = g_PendingInput;
+        g_PendingInput.yawDelta = 0.0f;
+        g_PendingInput.pitchDelta = 0.0f;
+    }
+    
+    CameraState previous = g_SimCamera;
+    ApplyPlayerInput(g_SimCamera, input, deltaTime);
+    // tick 时间从 deltaTime 开始（ShouldTeleport 把 0 视为不检查冷却）
+    bool teleported = UpdatePlayer(g_SimCamera, (float)(tick + 1) * deltaTime);
+    if (teleported) g_SimTeleports++;
+    
+    WorldSnapshot& snapshot = g_WorldSnapshots.Back();
+    snapshot.tick = tick;
+    snapshot.previous = teleported ? g_SimCamera : previous;
+    snapshot.current = g_SimCamera;
+    snapshot.teleports = g_SimTeleports;
+    snapshot.publishNs = SteadyNowNs();
+    g_WorldSnapshots.Publish();
+}
+
+// 渲染线程：取最新快照，按距发布的时间在两个 tick 之间插值（相机落后模拟一个 tick）
+void ApplyWorldSnapshot() {
+    g_WorldSnapshots.Update();
+    const WorldSnapshot& snapshot = g_WorldSnapshots.Front();
+    double tickNs = 1.0e9 / SIMULATION_TICK_RATE;
+    float alpha = (float)glm::clamp((double)(SteadyNowNs() - snapshot.publishNs) / tickNs, 0.0, 1.0);
+    g_CameraPosition = glm::mix(snapshot.previous.position, snapshot.current.position, alpha);
+    g_CameraYaw = glm::mix(snapshot.previous.yaw, snapshot.current.yaw, alpha);
+    g_CameraPitch = glm::mix(snapshot.previous.pitch, snapshot.current.pitch, alpha);
+}
+
+// Portal frame mesh for visual representation
+// 模型矩阵需右乘 mesh.dequantize
+static PortalGeometry::StaticMesh g_PortalFrameMesh;
+static PortalGeometry::StaticMesh g_PortalSurfaceMesh;     // 正面发光效果
+static PortalGeometry::StaticMesh g_PortalBackMesh;        // 背面不透明遮挡
+
+const char* PORTAL_FRAME_VS = R"(
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aColor;           // 门框网格为白色，乘以实例颜色
+uniform samplerBuffer uFrameInstances;          // 每个实例 5 个纹素：模型矩阵 4 列（已包含反量化）+ 颜色
+uniform usamplerBuffer uFrameIndices;           // 全部视图的可见门框下标
+uniform int uFrameIndexOffset;                  // 本视图的下标在 uFrameIndices 中的起点
+out vec3 vColor;
+void main() {
+    int base = int(texelFetch(uFrameIndices, uFrameIndexOffset + gl_InstanceID).r) * 5;
+    mat4 model = mat4(texelFetch(uFrameInstances, base), texelFetch(uFrameInstances, base + 1),
+                      texelFetch(uFrameInstances, base + 2), texelFetch(uFrameInstances, base + 3));
+    gl_Position = uViewProjection * model * vec4(aPos, 1.0);
+    vColor = aColor * texelFetch(uFrameInstances, base + 4).rgb;
 }
+)";
 
-// Portal frame VAO for visual representation
-static GLuint g_PortalFrameVAO = 0;
-static int g_PortalFrameVertCount = 0;
-static GLuint g_PortalSurfaceVAO = 0;       // 正面发光效果
-static int g_PortalSurfaceVertCount = 0;
-static GLuint g_PortalBackVAO = 0;          // 背面不透明遮挡
-static int g_PortalBackVertCount = 0;
+// 创建门框实例和可见门框下标的缓冲纹理（存储每帧按实际大小重新分配，纹理绑定保持不变）
+void CreatePortalFrameInstancing() {
+    PortalFrameInstances& frames = g_PortalFrames;
+    g_PortalFrameProgram.Build("portal frame", PORTAL_FRAME_VS, SCENE_FS);
+    
+    glGenBuffers(1, &frames.instanceBuffer);
+    glGenBuffers(1, &frames.indexBuffer);
+    glGenTextures(1, &frames.instanceTexture);
+    glGenTextures(1, &frames.indexTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, frames.instanceBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, frames.indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    
+    glActiveTexture(GL_TEXTURE0 + PORTAL_FRAME_INSTANCE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, frames.instanceTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, frames.instanceBuffer);
+    glActiveTexture(GL_TEXTURE0 + PORTAL_FRAME_INDEX_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, frames.indexTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, frames.indexBuffer);
+    glActiveTexture(GL_TEXTURE0);
+    
+    PortalGL::GetStateCache().UseProgram(g_PortalFrameProgram.id);
+    glUniform1i(g_PortalFrameProgram[PortalGL::UNIFORM_FRAME_INSTANCES], PORTAL_FRAME_INSTANCE_TEXTURE_UNIT);
+    glUniform1i(g_PortalFrameProgram[PortalGL::UNIFORM_FRAME_INDICES], PORTAL_FRAME_INDEX_TEXTURE_UNIT);
+}
 
 void CreatePortalVisuals() {
     // Portal frame (outline around each portal)
+    // 白色网格，颜色由实例数据给出
     std::vector<float> frameVerts;
     float w = PORTAL_WIDTH / 2.0f;
     float h = PORTAL_HEIGHT / 2.0f;
-    float frameThickness = 0.15f;
-    glm::vec3 frameColorA(0.1f, 0.5f, 1.0f);  // Blue portal
-    glm::vec3 frameColorB(1.0f, 0.5f, 0.1f);  // Orange portal
+    float frameThickness = PORTAL_FRAME_THICKNESS;
+    glm::vec3 frameColor(1.0f);
     
-    // Create frame geometry (for Portal A - will be transformed)
+    // Create frame geometry (shared by every portal - transformed per instance)
     // Top bar
     AddBox(frameVerts, glm::vec3(0, h + frameThickness/2, 0), 
-           glm::vec3(w * 2 + frameThickness * 2, frameThickness, frameThickness), frameColorA);
+           glm::vec3(w * 2 + frameThickness * 2, frameThickness, frameThickness), frameColor);
     // Bottom bar
     AddBox(frameVerts, glm::vec3(0, -h - frameThickness/2, 0), 
-           glm::vec3(w * 2 + frameThickness * 2, frameThickness, frameThickness), frameColorA);
+           glm::vec3(w * 2 + frameThickness * 2, frameThickness, frameThickness), frameColor);
     // Left bar
     AddBox(frameVerts, glm::vec3(-w - frameThickness/2, 0, 0), 
-           glm::vec3(frameThickness, h * 2, frameThickness), frameColorA);
+           glm::vec3(frameThickness, h * 2, frameThickness), frameColor);
     // Right bar
     AddBox(frameVerts, glm::vec3(w + frameThickness/2, 0, 0), 
-           glm::vec3(frameThickness, h * 2, frameThickness), frameColorA);
+           glm::vec3(frameThickness, h * 2, frameThickness), frameColor);
     
-    g_PortalFrameVAO = CreateVAOFromVertices(frameVerts);
-    g_PortalFrameVertCount = (int)frameVerts.size() / 6;
+    g_PortalFrameMesh = CreateStaticMesh("portal frame", frameVerts);
+    CreatePortalFrameInstancing();
     
     // ============ 门户表面（用于模板标记和深度清除）============
     // 双面门户：需要从两面都能看到，所以添加正反两面
@@ -565,8 +1168,7 @@ void CreatePortalVisuals() {
         glm::vec3(w, -h, 0.0f), glm::vec3(-w, -h, 0.0f),
         glm::vec3(-w, h, 0.0f), glm::vec3(w, h, 0.0f), surfaceColor);
     
-    g_PortalSurfaceVAO = CreateVAOFromVertices(surfaceVerts);
-    g_PortalSurfaceVertCount = (int)surfaceVerts.size() / 6;
+    g_PortalSurfaceMesh = CreateStaticMesh("portal surface", surfaceVerts);
     
     // ============ 背面不透明遮挡（朝向 -Z）============
     std::vector<float> backVerts;
@@ -575,37 +1177,35 @@ void CreatePortalVisuals() {
         glm::vec3(w, -h, -0.02f), glm::vec3(-w, -h, -0.02f),
         glm::vec3(-w, h, -0.02f), glm::vec3(w, h, -0.02f), backColor);
     
-    g_PortalBackVAO = CreateVAOFromVertices(backVerts);
-    g_PortalBackVertCount = (int)backVerts.size() / 6;
+    g_PortalBackMesh = CreateStaticMesh("portal back", backVerts);
 }
 
 // Shader for portal surface with animated effect
-static GLuint g_PortalSurfaceShader = 0;
+static PortalGL::ShaderProgram g_PortalSurfaceProgram;
 
 const char* PORTAL_SURFACE_VS = R"(
-#version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aColor;
-uniform mat4 uMVP;
-uniform mat4 uModel;
+uniform mat4 uModel;          // 已包含反量化
+uniform mat4 uDequantize;     // 量化位置 → 门户局部坐标
 out vec3 vColor;
 out vec3 vLocalPos;
 void main() {
-    gl_Position = uMVP * vec4(aPos, 1.0);
+    gl_Position = uViewProjection * uModel * vec4(aPos, 1.0);
     vColor = aColor;
-    vLocalPos = aPos;
+    vLocalPos = (uDequantize * vec4(aPos, 1.0)).xyz;
 }
 )";
 
 const char* PORTAL_SURFACE_FS = R"(
-#version 330 core
 in vec3 vColor;
 in vec3 vLocalPos;
 out vec4 FragColor;
-uniform float uTime;
 uniform vec3 uPortalColor;
 
 void main() {
+    float uTime = uCameraPosTime.w;
+    
     // Create swirling effect
     vec2 uv = vLocalPos.xy;
     float dist = length(uv);
@@ -634,21 +1234,7 @@ void main() {
 )";
 
 void CreatePortalSurfaceShader() {
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &PORTAL_SURFACE_VS, nullptr);
-    glCompileShader(vs);
-    
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &PORTAL_SURFACE_FS, nullptr);
-    glCompileShader(fs);
-    
-    g_PortalSurfaceShader = glCreateProgram();
-    glAttachShader(g_PortalSurfaceShader, vs);
-    glAttachShader(g_PortalSurfaceShader, fs);
-    glLinkProgram(g_PortalSurfaceShader);
-    
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    g_PortalSurfaceProgram.Build("portal surface", PORTAL_SURFACE_VS, PORTAL_SURFACE_FS);
 }
 
 // ============================================================================
@@ -656,44 +1242,7 @@ void CreatePortalSurfaceShader() {
 // ============================================================================
 void CreateSkybox() {
     // 创建天空盒着色器
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &SKYBOX_VS, nullptr);
-    glCompileShader(vs);
-    
-    // 检查编译错误
-    GLint success;
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(vs, 512, nullptr, infoLog);
-        std::cerr << "Skybox VS compile error: " << infoLog << std::endl;
-    }
-    
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &SKYBOX_FS, nullptr);
-    glCompileShader(fs);
-    
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(fs, 512, nullptr, infoLog);
-        std::cerr << "Skybox FS compile error: " << infoLog << std::endl;
-    }
-    
-    g_SkyboxShader = glCreateProgram();
-    glAttachShader(g_SkyboxShader, vs);
-    glAttachShader(g_SkyboxShader, fs);
-    glLinkProgram(g_SkyboxShader);
-    
-    glGetProgramiv(g_SkyboxShader, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(g_SkyboxShader, 512, nullptr, infoLog);
-        std::cerr << "Skybox shader link error: " << infoLog << std::endl;
-    }
-    
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    g_SkyboxProgram.Build("skybox", SKYBOX_VS, SKYBOX_FS);
     
     // 创建天空盒立方体顶点
     float skyboxVertices[] = {
@@ -757,27 +1306,133 @@ void CreateSkybox() {
     glBindVertexArray(0);
 }
 
-void RenderSkybox(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float time) {
-    // 禁用深度写入，但保持深度测试
-    glDepthFunc(GL_LEQUAL);
-    glDepthMask(GL_FALSE);
+// 把实时天空渲染到 target 的一个面（视图方向为立方体贴图约定的面方向，90° 视场）
+void BakeSkyFace(GLuint target, int face, float time) {
+    static const glm::vec3 faceDirections[6] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+    };
+    static const glm::vec3 faceUps[6] = {
+        { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 }
+    };
     
-    glUseProgram(g_SkyboxShader);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, target, 0);
     
-    // 移除视图矩阵的平移分量（天空盒应该始终围绕相机）
-    glm::mat4 viewNoTranslation = glm::mat4(glm::mat3(viewMatrix));
-    glm::mat4 viewProj = projectionMatrix * viewNoTranslation;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), faceDirections[face], faceUps[face]);
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+    g_ViewUniforms.Bind(g_ViewUniforms.Push(PortalGL::MakeViewUniforms(view, projection, glm::vec3(0.0f), time)));
     
-    glUniformMatrix4fv(glGetUniformLocation(g_SkyboxShader, "uViewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
-    glUniform1f(glGetUniformLocation(g_SkyboxShader, "uTime"), time);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+}
+
+/**
+ * 烘焙模式下每帧调用：向后台立方体贴图烘焙若干个面，一轮完成后交换前后台
+ * 需在本帧 g_ViewUniforms.BeginFrame 之后调用，调用后 ViewBlock 绑定被改变
+ * @param forceAll 一次烘焙完整的一轮并交换（初始化、切换到烘焙模式时）
+ */
+void UpdateSkyCubemap(float currentTime, bool forceAll) {
+    SkyCubemap& sky = g_SkyCubemap;
+    sky.facesBaked = 0;
+    
+    // 上一轮已完成：等待刷新间隔后开始新一轮
+    if (sky.nextFace == 0) {
+        if (!forceAll && sky.lastCycleStart >= 0.0f && currentTime - sky.lastCycleStart < sky.refreshInterval) return;
+        sky.cycleTime = currentTime;
+        sky.lastCycleStart = currentTime;
+    }
     
-    glBindVertexArray(g_SkyboxVAO);
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, sky.fbo);
+    glViewport(0, 0, SKY_CUBEMAP_SIZE, SKY_CUBEMAP_SIZE);
+    
+    // 每个像素都覆盖，不需要深度；立方体贴图面的朝向约定不同，关闭背面剔除
+    state.Disable(GL_DEPTH_TEST);
+    state.Disable(GL_CULL_FACE);
+    state.Disable(GL_STENCIL_TEST);
+    state.Disable(GL_SCISSOR_TEST);
+    state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    state.UseProgram(g_SkyboxProgram.id);
+    state.BindVertexArray(g_SkyboxVAO);
+    
+    GLuint back = sky.textures[1 - sky.front];
+    int budget = forceAll ? 6 : glm::clamp(sky.facesPerFrame, 1, 6);
+    while (budget-- > 0 && sky.nextFace < 6) {
+        BakeSkyFace(back, sky.nextFace++, sky.cycleTime);
+        sky.facesBaked++;
+    }
+    if (sky.nextFace == 6) {
+        sky.nextFace = 0;
+        sky.front = 1 - sky.front;
+        glActiveTexture(GL_TEXTURE0 + SKY_CUBEMAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, sky.textures[sky.front]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    
+    state.Enable(GL_DEPTH_TEST);
+    state.Enable(GL_CULL_FACE);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_BackbufferFBO);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void CreateSkyCubemap() {
+    SkyCubemap& sky = g_SkyCubemap;
+    glGenTextures(2, sky.textures);
+    for (GLuint texture : sky.textures) {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        for (int face = 0; face < 6; face++) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, SKY_CUBEMAP_SIZE, SKY_CUBEMAP_SIZE,
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glGenFramebuffers(1, &sky.fbo);
+    
+    // 面与面之间跨边过滤
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    
+    g_SkyboxBakedProgram.Build("skybox baked", SKYBOX_VS, SKYBOX_BAKED_FS);
+    PortalGL::GetStateCache().UseProgram(g_SkyboxBakedProgram.id);
+    glUniform1i(g_SkyboxBakedProgram[PortalGL::UNIFORM_SKY_CUBEMAP], SKY_CUBEMAP_TEXTURE_UNIT);
+}
+
+void DestroySkyCubemap() {
+    SkyCubemap& sky = g_SkyCubemap;
+    if (sky.fbo) glDeleteFramebuffers(1, &sky.fbo);
+    glDeleteTextures(2, sky.textures);
+    g_SkyboxBakedProgram.Destroy();
+    sky = SkyCubemap();
+}
+
+void SetSkyMode(SkyMode mode) {
+    g_SkyMode = mode;
+    // 切换到烘焙模式时重新开始一轮，下一帧同步烘焙全部六个面
+    g_SkyCubemap.nextFace = 0;
+    g_SkyCubemap.lastCycleStart = -1.0f;
+    g_SkyCubemap.facesBaked = 0;
+    PORTAL_LOG(General, Info, "Sky mode: %s", mode == SkyMode::Baked ? "Baked" : "Live");
+}
+
+// 视图（已移除平移分量，天空盒始终围绕相机）和时间来自当前绑定的 ViewBlock
+void RenderSkybox() {
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    // 禁用深度写入，但保持深度测试
+    state.DepthFunc(GL_LEQUAL);
+    state.DepthMask(GL_FALSE);
+    
+    state.UseProgram(g_SkyMode == SkyMode::Baked ? g_SkyboxBakedProgram.id : g_SkyboxProgram.id);
+    
+    state.BindVertexArray(g_SkyboxVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
     
     // 恢复状态
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LESS);
+    state.DepthMask(GL_TRUE);
+    state.DepthFunc(GL_LESS);
 }
 
 // ============================================================================
@@ -810,6 +1465,11 @@ glm::mat4 ComputeObliqueProjection(const glm::mat4& projection, const glm::vec4&
     return result;
 }
 
+// 设置当前视图的裁剪矩形（需已启用 GL_SCISSOR_TEST）
+void ApplyScissor(const PortalMath::ScreenRect& rect) {
+    PortalGL::GetStateCache().Scissor(rect.x, rect.y, rect.width, rect.height);
+}
+
 // 检查门户是否在视锥体内（简化版：检查门户中心是否在摄像机前方）
 bool IsPortalVisible(PortalRenderer::Portal* portal, const glm::vec3& cameraPos, const glm::vec3& cameraForward) {
     glm::vec3 portalPos = glm::vec3(portal->transform[3]);
@@ -838,404 +1498,859 @@ int GetPortalViewingSide(PortalRenderer::Portal* portal, const glm::vec3& camera
 }
 
 // 前向声明
-void RenderPortalFramesExcluding(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, 
-                                  float time, PortalRenderer::Portal* excludePortal);
+void ComputePortalFrameList(const PortalCulling::Frustum& frustum, const PortalSectors::CellVisit* visits,
+                            int visitCount, const PortalRenderer::Portal* excludePortal,
+                            std::vector<uint32_t>& indices);
+void DrawPortalFrames(int first, GLsizei count);
+void GetPortalFrameBounds(const PortalRenderer::Portal* portal, glm::vec3& outMin, glm::vec3& outMax);
 
-// 渲染单个门户的内容（递归，支持双面门户）
-// viewingSide: 1 = 从正面观察, -1 = 从背面观察
-void RenderPortalContent(PortalRenderer::Portal* portal, 
-                         const glm::mat4& viewMatrix, 
-                         const glm::mat4& projectionMatrix,
-                         const glm::vec3& cameraPos,
-                         int recursionLevel,
-                         int stencilValue,
-                         float currentTime,
-                         int viewingSide = 1);
-
-// 递归渲染所有门户（双面门户版本）
-// excludePortal: 排除的门户（正在通过的门户，避免在递归中重复渲染）
-void RenderPortalsRecursive(const glm::mat4& viewMatrix, 
-                            const glm::mat4& projectionMatrix,
-                            const glm::vec3& cameraPos,
-                            const glm::vec3& cameraForward,
-                            int recursionLevel,
-                            int stencilValue,
-                            float currentTime,
-                            PortalRenderer::Portal* excludePortal = nullptr) {
-    if (recursionLevel >= MAX_PORTAL_RECURSION) {
-        return;
+// 调试标志 - 每秒只输出一次
+static float g_LastDebugTime = 0.0f;
+static bool g_DebugThisFrame = false;
+
+// ============================================================================
+// 门户视图树：先在 CPU 上遍历出扁平的视图数组，再统一提交 GL 命令
+// ============================================================================
+
+/**
+ * 一个门户视图（透过某个门户看到的画面）
+ * 节点按深度优先先序存放，子树是 [index + 1, subtreeEnd) 的连续区间
+ */
+struct PortalViewNode {
+    int parent = -1;                            // 父视图索引（-1 = 主视图）
+    int subtreeEnd = 0;                         // 子树结束位置（不含）
+    int depth = 0;                              // 0 = 主视图，1 = 第一层门户……
+    PortalRenderer::Portal* portal = nullptr;   // 入口门户（其门户对在子视图中被排除）
+    PortalMath::RigidTransform view;            // 虚拟视图（刚体）
+    glm::mat4 viewMatrix;                       // GL 上传用
+    glm::mat4 projection;                       // 斜裁剪后的投影
+    glm::vec4 clipPlane;                        // 出口门户平面（虚拟视图空间）
+    glm::vec3 cameraPos;                        // 虚拟相机世界位置
+    glm::vec3 cameraForward;                    // 虚拟相机前向
+    int stencilRef = 0;                         // 本视图区域的模板值（= 深度，兄弟视图复用）
+    PortalMath::ScreenRect scissor;             // 屏幕裁剪矩形
+    GLintptr uniformOffset = 0;                 // 本视图 ViewUniforms 在 g_ViewUniforms 中的偏移
+    uint64_t viewKey = 0;                       // 视图路径（每层16位门户索引），跨帧标识遮挡查询
+    bool occludedLastFrame = false;             // 上一帧查询为完全遮挡：只标记模板，不绘制内容和子视图
+    int startCell = -1;                         // 扇区遍历的起点（相机所在扇区或出口门户所在扇区）
+    int firstCellVisit = 0;                     // 本视图的扇区遍历结果在 cellVisits 中的区间
+    int cellVisitCount = 0;
+};
+
+/**
+ * 每帧的视图树。帧间复用，Clear 不释放容量
+ * 孔径视锥体较大且只在剔除时用到，单独放在并行数组里，保持节点紧凑
+ */
+struct PortalViewTree {
+    std::vector<PortalViewNode> nodes;
+    std::vector<PortalCulling::Frustum> frustums;   // frustums[i] 对应 nodes[i]
+    std::vector<PortalSectors::CellVisit> cellVisits;   // 所有视图的可达扇区，按节点区间划分
+
+    void Clear() {
+        nodes.clear();
+        frustums.clear();
+        cellVisits.clear();
     }
-    
-    for (size_t i = 0; i < g_Portals.size(); i++) {
-        PortalRenderer::Portal* portal = g_Portals[i];
-        
-        if (!portal->isActive || !portal->linkedPortal) continue;
-        
-        // 关键修复：排除当前正在通过的门户对
-        // 当通过门户A看时，不应该再在L1中渲染门户A或门户B
-        // 因为我们已经"在"门户B的出口了，再次渲染会导致位置错误
-        if (excludePortal != nullptr) {
-            if (portal == excludePortal || portal == excludePortal->linkedPortal) {
-                continue;
+};
+
+static PortalViewTree g_PortalViewTree;
+static PortalRenderer::StencilAllocator g_StencilAllocator;
+
+// viewKey 每层占16位，64位最多容纳4层
+static_assert(MAX_PORTAL_RECURSION <= 4, "viewKey holds at most 4 recursion levels");
+
+// ============================================================================
+// 门户遮挡查询：门户的模板标记绘制同时作为 GL_ANY_SAMPLES_PASSED 查询
+// 被墙体/柱子完全挡住的门户不再绘制其天空盒、场景、门框和子视图
+// ============================================================================
+
+enum class PortalOcclusionMode {
+    Off,            // 不做遮挡查询
+    Conditional,    // 本帧查询 + 条件渲染（GPU 等待结果，CPU 不阻塞）
+    PreviousFrame,  // 用上一帧的结果在遍历阶段跳过整棵子树（无等待，可见性可能滞后一帧）
+};
+
+static PortalOcclusionMode g_OcclusionMode = PortalOcclusionMode::Conditional;
+
+const char* GetOcclusionModeName(PortalOcclusionMode mode) {
+    switch (mode) {
+        case PortalOcclusionMode::Off:           return "Off";
+        case PortalOcclusionMode::Conditional:   return "Conditional";
+        case PortalOcclusionMode::PreviousFrame: return "PreviousFrame";
+    }
+    return "Unknown";
+}
+
+// 每帧计数
+struct PortalOcclusionStats {
+    int queriesIssued = 0;      // 本帧发出的查询数
+    int viewsSkipped = 0;       // 按上一帧结果在 CPU 上跳过的视图数（PreviousFrame）
+    int viewsOccluded = 0;      // 本帧取回的结果中完全被遮挡的视图数
+};
+
+static PortalOcclusionStats g_OcclusionStats;
+
+// 每条视图路径（viewKey）一个查询对象，跨帧复用
+struct OcclusionQueryEntry {
+    GLuint query = 0;
+    bool pending = false;       // 已发出、结果尚未取回
+    bool visible = true;        // 最近一次取回的结果（未知时视为可见）
+    uint32_t lastUsedFrame = 0;
+};
+
+static std::unordered_map<uint64_t, OcclusionQueryEntry> g_OcclusionQueries;
+static uint32_t g_OcclusionFrame = 0;
+
+// 连续这么多帧未使用的查询对象会被回收
+const uint32_t OCCLUSION_QUERY_EVICT_FRAMES = 120;
+
+// 帧开始时调用：非阻塞地取回已完成的查询结果，回收长期未用的查询对象
+void CollectOcclusionResults() {
+    PORTAL_CPU_ZONE("Collect Occlusion");
+    g_OcclusionFrame++;
+    g_OcclusionStats = PortalOcclusionStats();
+    
+    for (auto it = g_OcclusionQueries.begin(); it != g_OcclusionQueries.end();) {
+        OcclusionQueryEntry& entry = it->second;
+        if (entry.pending) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint anySamples = 0;
+                glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT, &anySamples);
+                entry.visible = anySamples != 0;
+                entry.pending = false;
+                if (!entry.visible) g_OcclusionStats.viewsOccluded++;
             }
         }
-        
-        // 从当前视图矩阵提取实际相机位置（支持递归层级）
-        glm::vec3 actualCameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
-        
-        // 检查门户可见性（使用实际相机位置）
-        if (!IsPortalVisible(portal, actualCameraPos, cameraForward)) continue;
-        
-        // 双面门户：从两面都可以看到对面场景
-        // 获取当前观察的是哪一面（使用实际相机位置）
-        int viewingSide = GetPortalViewingSide(portal, actualCameraPos);
-        
-        // 为这个门户渲染内容（传递观察方向，并传递排除门户以供下一层递归使用）
-        RenderPortalContent(portal, viewMatrix, projectionMatrix, actualCameraPos, 
-                           recursionLevel, stencilValue + (int)i + 1, currentTime, viewingSide);
+        if (!entry.pending && g_OcclusionFrame - entry.lastUsedFrame > OCCLUSION_QUERY_EVICT_FRAMES) {
+            glDeleteQueries(1, &entry.query);
+            it = g_OcclusionQueries.erase(it);
+        } else {
+            ++it;
+        }
     }
 }
 
-// 调试标志 - 每秒只输出一次
-static float g_LastDebugTime = 0.0f;
-static bool g_DebugThisFrame = false;
+// 遍历阶段（纯 CPU）：该视图上一次查询是否完全被遮挡
+bool WasViewOccluded(uint64_t viewKey) {
+    if (g_OcclusionMode != PortalOcclusionMode::PreviousFrame) return false;
+    auto it = g_OcclusionQueries.find(viewKey);
+    return it != g_OcclusionQueries.end() && !it->second.visible;
+}
 
-void RenderPortalContent(PortalRenderer::Portal* portal, 
-                         const glm::mat4& viewMatrix, 
-                         const glm::mat4& projectionMatrix,
-                         const glm::vec3& cameraPos,
-                         int recursionLevel,
-                         int stencilValue,
-                         float currentTime,
-                         int viewingSide) {
-    
-    // RenderDoc 调试标记
-    char debugName[128];
-    glm::vec3 portalPos = glm::vec3(portal->transform[3]);
-    snprintf(debugName, sizeof(debugName), "Portal L%d @ (%.1f, %.1f, %.1f) Stencil=%d", 
-             recursionLevel, portalPos.x, portalPos.y, portalPos.z, stencilValue);
-    PushDebugGroup(debugName);
-    
-    PortalRenderer::Portal* destPortal = portal->linkedPortal;
-    
-    // 双面门户：根据观察方向调整入口门户的变换
-    // 如果从背面观察，我们需要翻转门户的法线
-    glm::mat4 effectiveSrcTransform = portal->transform;
-    if (viewingSide < 0) {
-        // 从背面观察：翻转门户（绕Y轴旋转180度）
-        effectiveSrcTransform = portal->transform * glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0, 1, 0));
+// 提交阶段：取得视图的查询对象并标记为待取回
+GLuint AcquireOcclusionQuery(uint64_t viewKey) {
+    OcclusionQueryEntry& entry = g_OcclusionQueries[viewKey];
+    if (entry.query == 0) {
+        glGenQueries(1, &entry.query);
     }
-    
-    // 调试输出（所有递归层级）
-    if (g_DebugThisFrame) {
-        glm::vec3 portalPos = glm::vec3(portal->transform[3]);
-        glm::vec3 destPos = glm::vec3(destPortal->transform[3]);
-        glm::vec3 portalNormal = glm::vec3(portal->transform * glm::vec4(0, 0, 1, 0));
-        std::cout << "[Portal Debug L" << recursionLevel << "] Rendering portal at (" << portalPos.x << ", " << portalPos.y << ", " << portalPos.z << ")" << std::endl;
-        std::cout << "  -> Normal: (" << portalNormal.x << ", " << portalNormal.y << ", " << portalNormal.z << ")" << std::endl;
-        std::cout << "  -> Viewing side: " << (viewingSide > 0 ? "FRONT" : "BACK") << std::endl;
-        std::cout << "  -> Destination: (" << destPos.x << ", " << destPos.y << ", " << destPos.z << ")" << std::endl;
-        std::cout << "  -> Camera pos (passed): (" << cameraPos.x << ", " << cameraPos.y << ", " << cameraPos.z << ")" << std::endl;
-        std::cout << "  -> Stencil value: " << stencilValue << std::endl;
-        // 从view matrix提取相机位置
-        glm::vec3 camFromView = glm::vec3(glm::inverse(viewMatrix)[3]);
-        std::cout << "  -> Camera pos (from viewMatrix): (" << camFromView.x << ", " << camFromView.y << ", " << camFromView.z << ")" << std::endl;
+    entry.pending = true;
+    entry.lastUsedFrame = g_OcclusionFrame;
+    g_OcclusionStats.queriesIssued++;
+    return entry.query;
+}
+
+// 切换模式：旧结果不再可信，全部视为可见
+void SetOcclusionMode(PortalOcclusionMode mode) {
+    g_OcclusionMode = mode;
+    for (auto& pair : g_OcclusionQueries) {
+        pair.second.visible = true;
     }
-    
-    // ========== 第1步：使用模板缓冲标记门户区域 ==========
-    glEnable(GL_STENCIL_TEST);
-    
-    // 配置模板测试：只在当前递归层级的区域内绘制
-    if (recursionLevel == 0) {
-        glStencilFunc(GL_ALWAYS, stencilValue, 0xFF);
-    } else {
-        glStencilFunc(GL_EQUAL, stencilValue - 1, 0xFF);
+    PORTAL_LOG(General, Info, "Portal occlusion mode: %s", GetOcclusionModeName(mode));
+}
+
+void DestroyOcclusionQueries() {
+    for (auto& pair : g_OcclusionQueries) {
+        glDeleteQueries(1, &pair.second.query);
+    }
+    g_OcclusionQueries.clear();
+}
+
+// 计算透过门户的子视图，返回 false 表示该门户在父视图中不可见或无法正确渲染
+// aperture: 门户四边形被父视图裁剪体裁剪后的多边形（世界空间，入口侧）
+bool ComputePortalView(const PortalViewNode& parent, PortalRenderer::Portal* portal,
+                       const PortalCulling::ConvexPolygon& aperture,
+                       PortalViewNode& outNode, PortalCulling::Frustum& outFrustum) {
+    // 门户表面在父视图中的 MVP，每个视图只计算一次
+    glm::mat4 portalMVP = parent.projection * parent.viewMatrix * portal->transform;
+    
+    // 门户四边形的屏幕矩形与父视图矩形求交
+    // 空矩形说明门户在父视图的可见区域之外，整个子树都可以跳过
+    outNode.scissor = PortalMath::IntersectScreenRects(
+        PortalMath::ComputePortalScreenRect(portalMVP, portal->width * 0.5f, portal->height * 0.5f,
+                                            g_FramebufferWidth, g_FramebufferHeight),
+        parent.scissor);
+    if (outNode.scissor.IsEmpty()) {
+        return false;
     }
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-    glStencilMask(0xFF);  // 确保模板可写
-    
-    // 禁用颜色和深度写入，只写入模板
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glDepthMask(GL_FALSE);
-    
-    // 禁用背面剔除，确保门户quad可以被绘制
-    glDisable(GL_CULL_FACE);
-    
-    // 绘制门户形状到模板缓冲
-    glUseProgram(g_SceneShader);
-    glm::mat4 portalMVP = projectionMatrix * viewMatrix * portal->transform;
-    glUniformMatrix4fv(glGetUniformLocation(g_SceneShader, "uMVP"), 1, GL_FALSE, glm::value_ptr(portalMVP));
-    
-    glBindVertexArray(g_PortalSurfaceVAO);
-    glDrawArrays(GL_TRIANGLES, 0, g_PortalSurfaceVertCount);
-    
-    // 恢复状态
-    glEnable(GL_CULL_FACE);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glDepthMask(GL_TRUE);
-    
-    // ========== 第2步：计算虚拟相机 ==========
-    // 使用 PortalMath 库计算正确的虚拟视图矩阵
-    // 关键：从入口门户看进去，应该看到出口门户背后的场景
-    glm::mat4 virtualViewMatrix = PortalMath::CalculatePortalViewMatrix(
-        viewMatrix, portal->transform, destPortal->transform);
-    
-    // 计算门户变换矩阵（用于将任何位置从入口侧映射到出口侧）
-    glm::mat4 portalTransform = PortalMath::ComputePortalTransform(portal->transform, destPortal->transform);
-    
-    // 从当前视图矩阵中提取相机位置（更准确，支持递归）
-    glm::vec3 currentCameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
     
-    // 计算虚拟相机位置（用于可见性检测和递归）
-    glm::vec3 virtualCameraPos = glm::vec3(portalTransform * glm::vec4(currentCameraPos, 1.0f));
+    // 调试输出（所有递归层级，--log portal=debug）
+    bool logPortal = g_DebugThisFrame && PortalLog::Enabled(PortalLog::Category::Portal, PortalLog::Level::Debug);
+    if (logPortal) {
+        glm::vec3 portalPos = glm::vec3(portal->transform[3]);
+        glm::vec3 destPos = glm::vec3(portal->linkedPortal->transform[3]);
+        glm::vec3 portalNormal = glm::vec3(portal->transform * glm::vec4(0, 0, 1, 0));
+        int viewingSide = GetPortalViewingSide(portal, parent.cameraPos);
+        PORTAL_LOG(Portal, Debug, "L%d portal at (%g, %g, %g) normal (%g, %g, %g) side %s -> (%g, %g, %g), camera (%g, %g, %g)",
+                   parent.depth, portalPos.x, portalPos.y, portalPos.z, portalNormal.x, portalNormal.y, portalNormal.z,
+                   viewingSide > 0 ? "FRONT" : "BACK", destPos.x, destPos.y, destPos.z,
+                   parent.cameraPos.x, parent.cameraPos.y, parent.cameraPos.z);
+    }
     
-    // 调试：输出虚拟相机位置
-    if (g_DebugThisFrame && recursionLevel == 0) {
-        glm::vec3 origCamPos = glm::vec3(glm::inverse(viewMatrix)[3]);
-        glm::vec3 virtCamPos = glm::vec3(glm::inverse(virtualViewMatrix)[3]);
-        std::cout << "  -> Original camera pos: (" << origCamPos.x << ", " << origCamPos.y << ", " << origCamPos.z << ")" << std::endl;
-        std::cout << "  -> Virtual camera pos: (" << virtCamPos.x << ", " << virtCamPos.y << ", " << virtCamPos.z << ")" << std::endl;
+    // ========== 计算虚拟相机 ==========
+    // 从入口门户看进去，应该看到出口门户背后的场景
+    // 门户对变换已缓存在 PortalLink 中，门户不动时无需重复求逆
+    const PortalMath::PortalLink& link = portal->GetLink();
+    outNode.view = PortalMath::CalculatePortalViewMatrix(parent.view, link);
+    outNode.viewMatrix = outNode.view.ToMatrix();
+    outNode.cameraPos = PortalMath::TeleportPosition(parent.cameraPos, link);
+    outNode.cameraForward = PortalMath::GetCameraForward(outNode.view);
+    
+    // 孔径视锥体：虚拟相机穿过（传送到出口侧的）孔径多边形，近平面为出口门户平面
+    // 出口侧场景和更深层门户都只针对这个裁剪体提交
+    outFrustum = PortalCulling::BuildApertureFrustum(
+        outNode.cameraPos, PortalCulling::TransformPolygon(aperture, link.forward), link.targetPlane);
+    
+    if (logPortal && parent.depth == 0) {
+        PORTAL_LOG(Portal, Debug, "  virtual camera (%g, %g, %g)", outNode.cameraPos.x, outNode.cameraPos.y, outNode.cameraPos.z);
     }
     
-    // ========== 第3步：计算斜裁剪投影矩阵 ==========
+    // ========== 计算斜裁剪投影矩阵 ==========
     // 使用出口门户平面作为近裁剪平面，避免渲染门户背后的物体
-    // 这是门户渲染的关键：只渲染出口门户前方的内容
-    glm::mat4 virtualProjection = projectionMatrix;
-    
-    // 获取出口门户的裁剪平面（在虚拟相机视图空间中）
-    // 裁剪平面应该位于出口门户的位置，法线指向门户正面
-    glm::vec3 destPortalPos = glm::vec3(destPortal->transform[3]);
-    glm::vec3 destPortalNormal = glm::normalize(glm::vec3(destPortal->transform * glm::vec4(0, 0, 1, 0)));
-    
-    // 将裁剪平面变换到虚拟相机的视图空间
-    glm::vec3 clipPosView = glm::vec3(virtualViewMatrix * glm::vec4(destPortalPos, 1.0f));
-    glm::vec3 clipNormalView = glm::normalize(glm::vec3(virtualViewMatrix * glm::vec4(destPortalNormal, 0.0f)));
+    // 裁剪平面位于出口门户的位置，变换到虚拟相机的视图空间
+    glm::vec3 clipPosView = outNode.view.TransformPoint(link.targetPosition);
+    glm::vec3 clipNormalView = glm::normalize(outNode.view.TransformDirection(link.targetForward));
     
     // 确保裁剪平面法线指向相机（即我们要保留平面前方的内容）
-    // 如果法线背对相机，翻转它
     if (clipNormalView.z > 0.0f) {
         clipNormalView = -clipNormalView;
     }
     
     // 构建裁剪平面方程 (Ax + By + Cz + D = 0)
-    // D = -dot(normal, point)
     float clipD = -glm::dot(clipNormalView, clipPosView);
-    glm::vec4 clipPlane(clipNormalView.x, clipNormalView.y, clipNormalView.z, clipD);
+    outNode.clipPlane = glm::vec4(clipNormalView, clipD);
     
     // 轻微向后偏移裁剪平面，避免精度问题导致的闪烁
-    clipPlane.w -= 0.01f;
+    outNode.clipPlane.w -= 0.01f;
     
-    // 检查裁剪平面是否有效 - 当从极端角度观察时，裁剪平面可能会导致数值问题
-    // 如果裁剪平面的 z 分量太小（几乎平行于视线），需要特殊处理
-    bool useObliqueClipping = true;
-    bool skipPortalRender = false;
-    
-    // 检查1：裁剪平面几乎平行于视线（z分量太小）
-    if (glm::abs(clipNormalView.z) < 0.05f) {
-        // 极端角度 - 尝试使用基于距离的近平面
-        useObliqueClipping = false;
-    }
-    
-    // 检查2：裁剪平面在相机后方或太近
-    // clipD 正值表示相机在平面的正面（平面法线指向的一侧）
-    // 由于我们翻转了法线使其指向相机，clipD 应该是负值（平面在相机前方）
-    // clipD = -dot(normal, pos)，如果 pos 在 normal 方向上，则为负
+    // 门户平面在相机后方或相机正好在平面上：不能使用斜裁剪，也不能正确渲染
+    // 由于法线已翻转为指向相机，平面在相机前方时 clipD 为负
     if (clipD > -0.01f) {
-        // 门户平面在相机后方或相机正好在平面上
-        // 不能使用斜裁剪，也不能正确渲染
-        skipPortalRender = true;
-    }
-    
-    // 如果需要跳过渲染，直接退出
-    if (skipPortalRender) {
-        glDisable(GL_STENCIL_TEST);
-        return;
+        return false;
     }
     
-    // 应用裁剪策略
-    if (useObliqueClipping) {
+    if (glm::abs(clipNormalView.z) >= 0.05f) {
         // 正常情况：使用斜裁剪投影矩阵
-        virtualProjection = PortalMath::CalculateObliqueProjectionMatrix(projectionMatrix, clipPlane);
+        outNode.projection = PortalMath::CalculateObliqueProjectionMatrix(parent.projection, outNode.clipPlane);
     } else {
-        // 极端角度但门户仍在前方：使用基于门户距离的近平面
-        // 门户平面距离（在视图空间中，z轴负方向为前方）
-        float portalDist = -clipPosView.z;  // 转换为正值（门户在前方时 z < 0）
-        
+        // 极端角度（裁剪平面几乎平行于视线）：使用基于门户距离的近平面
+        float portalDist = -clipPosView.z;  // 门户在前方时 z < 0
         if (portalDist < 0.1f) {
-            // 门户太近或在后方，跳过渲染
-            glDisable(GL_STENCIL_TEST);
-            return;
+            return false;
         }
         
         // 使用门户距离作为近平面（稍微减小以避免裁剪门户本身）
         float safeNearPlane = glm::max(0.01f, portalDist * 0.9f);
         
         // 从原投影矩阵提取参数
-        float fov = 2.0f * glm::atan(1.0f / projectionMatrix[1][1]);
-        float aspect = projectionMatrix[1][1] / projectionMatrix[0][0];
+        float fov = 2.0f * glm::atan(1.0f / parent.projection[1][1]);
+        float aspect = parent.projection[1][1] / parent.projection[0][0];
         float farPlane = 100.0f;
         
-        virtualProjection = glm::perspective(fov, aspect, safeNearPlane, farPlane);
+        outNode.projection = glm::perspective(fov, aspect, safeNearPlane, farPlane);
+    }
+    
+    if (logPortal && parent.depth == 0) {
+        PORTAL_LOG(Portal, Debug, "  clip plane (view space) (%g, %g, %g, %g)",
+                   outNode.clipPlane.x, outNode.clipPlane.y, outNode.clipPlane.z, outNode.clipPlane.w);
+    }
+    
+    outNode.portal = portal;
+    outNode.depth = parent.depth + 1;
+    return true;
+}
+
+// 从视图的起始扇区遍历扇区图，结果追加到 tree.cellVisits
+void TraverseViewSectors(PortalViewTree& tree, int index) {
+    PortalViewNode& node = tree.nodes[index];
+    node.firstCellVisit = (int)tree.cellVisits.size();
+    g_Sectors.Traverse(node.startCell, node.cameraPos, tree.frustums[index], tree.cellVisits);
+    node.cellVisitCount = (int)tree.cellVisits.size() - node.firstCellVisit;
+}
+
+/**
+ * 门户在父视图中的孔径：门户所在扇区必须可达，门户四边形用到达该扇区时的裁剪体裁剪
+ * 扇区经多条路径到达时，各裁剪体的并集不是凸的，退回到父视图的裁剪体（保守）
+ */
+PortalCulling::ConvexPolygon ComputePortalAperture(const PortalViewTree& tree, int parentIndex,
+                                                   const PortalRenderer::Portal* portal) {
+    PortalCulling::ConvexPolygon polygon =
+        PortalCulling::GetPortalPolygon(portal->transform, portal->width * 0.5f, portal->height * 0.5f);
+    if (portal->cell < 0) return PortalCulling::ClipPolygon(polygon, tree.frustums[parentIndex]);
+    
+    const PortalViewNode& parent = tree.nodes[parentIndex];
+    PortalCulling::ConvexPolygon aperture;
+    int reached = 0;
+    for (int v = parent.firstCellVisit; v < parent.firstCellVisit + parent.cellVisitCount; v++) {
+        const PortalSectors::CellVisit& visit = tree.cellVisits[v];
+        if (visit.cell != portal->cell) continue;
+        PortalCulling::ConvexPolygon clipped = PortalCulling::ClipPolygon(polygon, visit.frustum);
+        if (clipped.IsEmpty()) continue;
+        aperture = clipped;
+        reached++;
+    }
+    if (reached > 1) return PortalCulling::ClipPolygon(polygon, tree.frustums[parentIndex]);
+    return aperture;
+}
+
+// 遍历阶段：深度优先追加 parentIndex 的所有可见子视图（纯 CPU，不触碰 GL 状态）
+void TraversePortalViews(PortalViewTree& tree, int parentIndex) {
+    if (tree.nodes[parentIndex].depth >= MAX_PORTAL_RECURSION) {
+        tree.nodes[parentIndex].subtreeEnd = (int)tree.nodes.size();
+        return;
+    }
+    
+    for (size_t i = 0; i < g_Portals.size(); i++) {
+        PortalRenderer::Portal* portal = g_Portals[i];
+        // 向量扩容会使引用失效，每次循环重新取父节点
+        const PortalViewNode& parent = tree.nodes[parentIndex];
+        
+        if (!portal->isActive || !portal->linkedPortal) continue;
+        
+        // 排除当前正在通过的门户对
+        // 当通过门户A看时，不应该再在子视图中渲染门户A或门户B
+        // 因为我们已经"在"门户B的出口了，再次渲染会导致位置错误
+        if (parent.portal != nullptr) {
+            if (portal == parent.portal || portal == parent.portal->linkedPortal) {
+                continue;
+            }
+        }
+        
+        // 检查门户可见性（使用父视图的相机位置）
+        if (!IsPortalVisible(portal, parent.cameraPos, parent.cameraForward)) continue;
+        
+        // 门户所在扇区在父视图中不可达，或门户四边形完全在孔径之外时不再递归
+        PortalCulling::ConvexPolygon aperture = ComputePortalAperture(tree, parentIndex, portal);
+        if (aperture.IsEmpty()) continue;
+        
+        PortalViewNode node;
+        PortalCulling::Frustum frustum;
+        if (!ComputePortalView(parent, portal, aperture, node, frustum)) continue;
+        
+        // 遍历顺序即提交顺序，分配器在这里就能看到每个时刻的存活视图
+        node.stencilRef = g_StencilAllocator.Acquire(parent.stencilRef);
+        if (node.stencilRef < 0) continue;
+        node.parent = parentIndex;
+        node.viewKey = (parent.viewKey << 16) | (uint64_t)(i + 1);
+        node.occludedLastFrame = WasViewOccluded(node.viewKey);
+        // 穿过门户后从出口门户所在的扇区继续
+        node.startCell = portal->linkedPortal->cell;
+        
+        int index = (int)tree.nodes.size();
+        tree.nodes.push_back(node);
+        tree.frustums.push_back(frustum);
+        TraverseViewSectors(tree, index);
+        if (node.occludedLastFrame) {
+            // 子视图只能透过本视图看到，一并跳过
+            tree.nodes[index].subtreeEnd = index + 1;
+            g_OcclusionStats.viewsSkipped++;
+        } else {
+            TraversePortalViews(tree, index);
+        }
+        g_StencilAllocator.Release(node.stencilRef);
     }
     
-    if (g_DebugThisFrame && recursionLevel == 0) {
-        std::cout << "  -> Clip plane (view space): (" << clipPlane.x << ", " << clipPlane.y << ", " << clipPlane.z << ", " << clipPlane.w << ")" << std::endl;
+    tree.nodes[parentIndex].subtreeEnd = (int)tree.nodes.size();
+}
+
+// 构建整帧的视图树：节点 0 是主视图，其余为门户视图
+void BuildPortalViewTree(PortalViewTree& tree,
+                         const PortalMath::RigidTransform& view,
+                         const glm::mat4& projectionMatrix,
+                         const PortalMath::ScreenRect& scissor,
+                         const PortalCulling::Frustum& frustum) {
+    PORTAL_CPU_ZONE("Build Portal View Tree");
+    tree.Clear();
+    g_StencilAllocator.Reset();
+    
+    PortalViewNode root;
+    root.view = view;
+    root.viewMatrix = view.ToMatrix();
+    root.projection = projectionMatrix;
+    root.cameraPos = PortalMath::GetCameraPosition(view);
+    root.cameraForward = PortalMath::GetCameraForward(view);
+    root.scissor = scissor;
+    root.startCell = g_Sectors.Locate(root.cameraPos);
+    tree.nodes.push_back(root);
+    tree.frustums.push_back(frustum);
+    TraverseViewSectors(tree, 0);
+    
+    TraversePortalViews(tree, 0);
+    
+    if (g_StencilAllocator.conflicts > 0 && g_DebugThisFrame) {
+        PORTAL_LOG(Portal, Warn, "Stencil allocator rejected %d portal views", g_StencilAllocator.conflicts);
+    }
+}
+
+// 提交阶段开始前：每个视图的 ViewUniforms 写入一次，之后按偏移绑定
+void UploadViewUniforms(PortalViewTree& tree, float currentTime) {
+    PORTAL_PROFILE_GROUP("Upload View Uniforms");
+    g_ViewUniforms.BeginFrame((int)tree.nodes.size());
+    for (PortalViewNode& node : tree.nodes) {
+        node.uniformOffset = g_ViewUniforms.Push(
+            PortalGL::MakeViewUniforms(node.viewMatrix, node.projection, node.cameraPos, currentTime));
+    }
+}
+
+// ============================================================================
+// 每视图渲染队列：绘制项按 64 位排序键排序后提交
+// 键从高到低为 通道 | 程序 | VAO | 量化深度：
+// 不透明通道内相同程序/VAO 的绘制相邻（减少状态切换），同状态内由近到远；
+// 天空盒在最后的通道，用 GL_LEQUAL 只填充没有被几何体覆盖的像素
+// ============================================================================
+
+enum RenderPass : uint64_t {
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_SKY = 1,
+};
+
+enum class DrawItemType {
+    ProceduralFloor,
+    Scene,              // 整个视图的场景多重绘制
+    PortalFrames,       // 本视图可见的门框（排除当前门户对）
+    Sky,
+};
+
+struct DrawItem {
+    uint64_t sortKey;
+    DrawItemType type;
+};
+
+// 深度按 [0, RENDER_QUEUE_MAX_DEPTH] 量化为24位，更远的绘制项共用最大值
+const float RENDER_QUEUE_MAX_DEPTH = 1000.0f;
+
+inline uint64_t MakeSortKey(RenderPass pass, GLuint program, GLuint vao, float depth) {
+    const uint64_t depthMax = (1ull << 24) - 1;
+    float normalized = glm::clamp(depth / RENDER_QUEUE_MAX_DEPTH, 0.0f, 1.0f);
+    uint64_t quantized = (uint64_t)(normalized * (float)depthMax);
+    return ((uint64_t)pass << 60)
+         | ((uint64_t)(program & 0xFFF) << 48)
+         | ((uint64_t)(vao & 0xFFF) << 36)
+         | (quantized << 12);
+}
+
+struct RenderQueue {
+    std::vector<DrawItem> items;    // 帧间复用
+    
+    void Clear() { items.clear(); }
+    void Push(RenderPass pass, GLuint program, GLuint vao, float depth, DrawItemType type) {
+        items.push_back({ MakeSortKey(pass, program, vao, depth), type });
+    }
+    void Sort() {
+        std::sort(items.begin(), items.end(),
+                  [](const DrawItem& a, const DrawItem& b) { return a.sortKey < b.sortKey; });
+    }
+};
+
+// 门框中离相机最近的距离（排除当前门户对），包围盒来自本帧的门框实例
+float NearestPortalFrameDepth(const glm::vec3& cameraPos, const PortalRenderer::Portal* excludePortal) {
+    float nearest = RENDER_QUEUE_MAX_DEPTH;
+    for (size_t i = 0; i < g_PortalFrames.instances.size(); i++) {
+        PortalRenderer::Portal* portal = g_Portals[i];
+        if (excludePortal != nullptr && (portal == excludePortal || portal == excludePortal->linkedPortal)) continue;
+        nearest = glm::min(nearest, DistanceToAABB(cameraPos, g_PortalFrames.boundsMin[i], g_PortalFrames.boundsMax[i]));
+    }
+    return nearest;
+}
+
+// ============================================================================
+// 并行构建每视图绘制列表
+// 视图树确定后，各视图的剔除、可见门框列表和渲染队列互不依赖：由工作线程并行构建
+// （只读场景、门框实例和视图树），GL 线程合并场景命令、上传，再按视图回放
+// ============================================================================
+
+struct ViewDrawList {
+    std::vector<SceneDrawCommand> commands;     // 本视图的场景命令，合并后追加到 g_SceneDraws
+    SceneDrawLists::Range range;
+    std::vector<uint32_t> frameIndices;         // 可见门框的实例下标（已排除当前门户对）
+    int frameIndexOffset = 0;                   // 合并后在 g_PortalFrames.visibleIndices 中的起点
+    RenderQueue queue;                          // 已排序的绘制项
+};
+
+// 每个执行线程一份的临时内存（按 JobPool 执行者下标）
+struct DrawListScratch {
+    std::vector<SceneDrawLists::VisibleObject> visible;
+    std::vector<uint32_t> objectStamps;         // 按物体下标，等于 stamp 时本视图已收集过
+    uint32_t stamp = 0;
+};
+
+static PortalJobs::JobPool g_JobPool;
+static std::vector<ViewDrawList> g_ViewDrawLists;       // 按视图树节点索引，帧间复用
+static std::vector<DrawListScratch> g_DrawListScratch;
+
+// 工作线程：剔除一个视图并生成排好序的渲染队列（不调用 GL）
+// 主视图不放门框：门框要在门户视图之后绘制，否则门户内容会覆盖门户平面前方的门框
+void BuildViewDrawList(const PortalViewTree& tree, int index, DrawListScratch& scratch) {
+    PORTAL_CPU_ZONE("Build View Draw List");
+    const PortalViewNode& node = tree.nodes[index];
+    ViewDrawList& list = g_ViewDrawLists[index];
+    const PortalSectors::CellVisit* visits = tree.cellVisits.data() + node.firstCellVisit;
+    if (++scratch.stamp == 0) {
+        std::fill(scratch.objectStamps.begin(), scratch.objectStamps.end(), 0);
+        scratch.stamp = 1;
+    }
+    BuildViewSceneCommands(list.commands, list.range, scratch.visible, scratch.objectStamps, scratch.stamp,
+                           visits, node.cellVisitCount, node.cameraPos);
+    ComputePortalFrameList(tree.frustums[index], visits, node.cellVisitCount, node.portal, list.frameIndices);
+    
+    RenderQueue& queue = list.queue;
+    queue.Clear();
+    if (list.range.floorVisible) {
+        queue.Push(RENDER_PASS_OPAQUE, g_FloorProgram.id, g_ProceduralFloorMesh.vao, list.range.floorDepth,
+                   DrawItemType::ProceduralFloor);
+    }
+    if (list.range.count > 0) {
+        queue.Push(RENDER_PASS_OPAQUE, g_SceneProgram.id, g_Scene.mesh.vao, list.range.nearestDepth, DrawItemType::Scene);
+    }
+    if (index != 0 && !list.frameIndices.empty()) {
+        queue.Push(RENDER_PASS_OPAQUE, g_PortalFrameProgram.id, g_PortalFrameMesh.vao,
+                   NearestPortalFrameDepth(node.cameraPos, node.portal), DrawItemType::PortalFrames);
+    }
+    GLuint skyProgram = g_SkyMode == SkyMode::Baked ? g_SkyboxBakedProgram.id : g_SkyboxProgram.id;
+    queue.Push(RENDER_PASS_SKY, skyProgram, g_SkyboxVAO, RENDER_QUEUE_MAX_DEPTH, DrawItemType::Sky);
+    queue.Sort();
+}
+
+// 提交阶段开始前：并行构建全部视图的绘制列表，合并并上传场景命令和可见门框下标（门框实例须已更新）
+void BuildSceneDrawLists(const PortalViewTree& tree) {
+    PORTAL_PROFILE_GROUP("Build Scene Draws");
+    int viewCount = (int)tree.nodes.size();
+    if ((int)g_ViewDrawLists.size() < viewCount) g_ViewDrawLists.resize(viewCount);
+    g_DrawListScratch.resize(g_JobPool.ExecutorCount());
+    g_JobPool.ParallelFor(viewCount, [&tree](int index, int worker) {
+        BuildViewDrawList(tree, index, g_DrawListScratch[worker]);
+    });
+    
+    // 按视图树顺序合并，每个视图的命令在间接缓冲中连续
+    PortalFrameInstances& frames = g_PortalFrames;
+    g_SceneDraws.commands.clear();
+    g_SceneDraws.views.clear();
+    frames.visibleIndices.clear();
+    for (int i = 0; i < viewCount; i++) {
+        ViewDrawList& list = g_ViewDrawLists[i];
+        list.range.first = (int)g_SceneDraws.commands.size();
+        g_SceneDraws.commands.insert(g_SceneDraws.commands.end(), list.commands.begin(), list.commands.end());
+        g_SceneDraws.views.push_back(list.range);
+        list.frameIndexOffset = (int)frames.visibleIndices.size();
+        frames.visibleIndices.insert(frames.visibleIndices.end(), list.frameIndices.begin(), list.frameIndices.end());
+    }
+    UploadSceneDrawCommands(g_SceneDraws);
+    glBindBuffer(GL_TEXTURE_BUFFER, frames.indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, frames.visibleIndices.size() * sizeof(uint32_t), frames.visibleIndices.data(),
+                 GL_STREAM_DRAW);
+}
+
+// 回放一个视图的渲染队列（视图的 ViewBlock 须已绑定）
+void RenderViewQueue(int index) {
+    const ViewDrawList& list = g_ViewDrawLists[index];
+    for (const DrawItem& item : list.queue.items) {
+        switch (item.type) {
+        case DrawItemType::ProceduralFloor:
+            PushDebugGroup("Floor");
+            RenderProceduralFloor();
+            break;
+        case DrawItemType::Scene:
+            PushDebugGroup("Scene");
+            RenderScene(index);
+            break;
+        case DrawItemType::PortalFrames:
+            // 门户边框作为场景的一部分用虚拟视图绘制，当前正在通过的门户对已从下标列表中排除
+            PushDebugGroup("Portal Frames");
+            DrawPortalFrames(list.frameIndexOffset, (GLsizei)list.frameIndices.size());
+            if (g_DebugThisFrame) {
+                PORTAL_LOG(Portal, Debug, "  [FramesExcluding] Rendered %d portal frames in one instanced draw",
+                           (int)list.frameIndices.size());
+            }
+            break;
+        case DrawItemType::Sky:
+            PushDebugGroup("Sky");
+            RenderSkybox();
+            break;
+        }
+        PopDebugGroup();
     }
+}
+
+// 提交阶段：绘制一个门户视图（模板标记 → 清深度 → 渲染队列：场景/门框由近到远，天空盒最后）
+// 子视图在它之后提交，全部完成后由 SealPortalView 收尾
+void SubmitPortalView(const PortalViewTree& tree, int index) {
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    const PortalViewNode& node = tree.nodes[index];
+    const PortalViewNode& parent = tree.nodes[node.parent];
+    
+    // RenderDoc 调试标记
+    char debugName[128];
+    glm::vec3 portalPos = glm::vec3(node.portal->transform[3]);
+    snprintf(debugName, sizeof(debugName), "Portal L%d @ (%.1f, %.1f, %.1f) Stencil=%d", 
+             node.depth - 1, portalPos.x, portalPos.y, portalPos.z, node.stencilRef);
+    PushDebugGroup(debugName);
+    
+    // ========== 第1步：使用模板缓冲标记门户区域 ==========
+    // 本视图的所有绘制（模板标记、深度清除、天空盒、场景、封口）都限制在裁剪矩形内
+    PushDebugGroup("Stencil Mark");
+    ApplyScissor(node.scissor);
+    state.Enable(GL_STENCIL_TEST);
+    
+    // 配置模板测试：只在父视图的区域内绘制，通过的像素由父视图的值加一
+    state.StencilFunc(GL_EQUAL, parent.stencilRef, PortalRenderer::STENCIL_DEPTH_MASK);
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    state.StencilMask(PortalRenderer::STENCIL_DEPTH_MASK);  // 只写深度位
     
-    // ========== 第4步：清除门户区域的深度和颜色缓冲 ==========
-    glStencilFunc(GL_EQUAL, stencilValue, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    glStencilMask(0x00);  // 不修改模板值
+    // 禁用颜色和深度写入，只写入模板
+    state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    state.DepthMask(GL_FALSE);
     
-    // 4a: 先清除深度缓冲（将深度设为远平面）
-    glDisable(GL_CULL_FACE);
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_ALWAYS);
-    glDepthRange(1.0, 1.0);  // 强制写入远平面深度
+    // 禁用背面剔除，确保门户quad可以被绘制
+    state.Disable(GL_CULL_FACE);
+    
+    // 在父视图中绘制门户形状到模板缓冲，同时查询是否有任何像素通过深度测试
+    state.UseProgram(g_SceneProgram.id);
+    g_ViewUniforms.Bind(parent.uniformOffset);
+    glm::mat4 surfaceModel = node.portal->transform * g_PortalSurfaceMesh.dequantize;
+    glUniformMatrix4fv(g_SceneProgram[PortalGL::UNIFORM_MODEL], 1, GL_FALSE, glm::value_ptr(surfaceModel));
+    
+    GLuint query = 0;
+    if (g_OcclusionMode != PortalOcclusionMode::Off) {
+        query = AcquireOcclusionQuery(node.viewKey);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+    }
     
-    glUseProgram(g_SceneShader);
-    glm::mat4 clearMVP = projectionMatrix * viewMatrix * portal->transform;
-    glUniformMatrix4fv(glGetUniformLocation(g_SceneShader, "uMVP"), 1, GL_FALSE, glm::value_ptr(clearMVP));
+    g_PortalSurfaceMesh.Draw();
     
-    glBindVertexArray(g_PortalSurfaceVAO);
-    glDrawArrays(GL_TRIANGLES, 0, g_PortalSurfaceVertCount);
+    if (query != 0) {
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+    PopDebugGroup();  // Stencil Mark
+    
+    // 上一帧完全被遮挡：模板标记已作为本帧的查询发出，跳过内容绘制
+    if (node.occludedLastFrame) {
+        state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        state.DepthMask(GL_TRUE);
+        state.Enable(GL_CULL_FACE);
+        return;
+    }
+    
+    // 条件渲染：门户被完全遮挡时，GPU 丢弃以下所有绘制
+    // 子视图的模板标记只能通过本视图的模板区域，会自然得到空结果
+    bool conditional = g_OcclusionMode == PortalOcclusionMode::Conditional;
+    if (conditional) {
+        glBeginConditionalRender(query, GL_QUERY_WAIT);
+    }
+    
+    // ========== 第2步：清除门户区域的深度缓冲 ==========
+    PushDebugGroup("Depth Clear");
+    state.StencilFunc(GL_EQUAL, node.stencilRef, PortalRenderer::STENCIL_DEPTH_MASK);
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    state.StencilMask(0x00);  // 不修改模板值
+    
+    // 将门户区域的深度设为远平面
+    state.DepthMask(GL_TRUE);
+    state.DepthFunc(GL_ALWAYS);
+    state.DepthRange(1.0, 1.0);  // 强制写入远平面深度
+    
+    g_PortalSurfaceMesh.Draw();
     
     // 恢复状态
-    glDepthRange(0.0, 1.0);
-    glDepthFunc(GL_LESS);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glEnable(GL_CULL_FACE);
-    glStencilMask(0xFF);
-    
-    // ========== 第5步：渲染门户另一侧的场景（先天空盒，后几何体）==========
-    // 关键：必须保持模板测试启用，确保只渲染到门户区域内
-    // 模板测试已经在第4步设置为 GL_EQUAL stencilValue
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_EQUAL, stencilValue, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    glStencilMask(0x00);  // 不修改模板值
-    
-    // 先渲染天空盒作为背景
-    RenderSkybox(virtualViewMatrix, virtualProjection, currentTime);
-    
-    // 再渲染场景几何体
-    RenderScene(virtualViewMatrix, virtualProjection);
-    
-    // 渲染门户边框（作为场景的一部分，使用虚拟视图矩阵）
-    // 但要排除当前正在通过的门户对的边框
-    RenderPortalFramesExcluding(virtualViewMatrix, virtualProjection, currentTime, portal);
-    
-    // ========== 第6步：递归渲染更深层的门户 ==========
-    // 从虚拟视图矩阵中提取相机前向向量（视图矩阵的第三行取反）
-    glm::mat4 invVirtualView = glm::inverse(virtualViewMatrix);
-    glm::vec3 virtualCameraForward = -glm::normalize(glm::vec3(invVirtualView[2]));
-    
-    // 关键修复：在递归时排除当前门户对
-    // 当通过门户A->B时，在L1层级不应该再渲染A或B
-    // 这样可以避免在不存在门户的位置看到错误的门户
-    RenderPortalsRecursive(virtualViewMatrix, virtualProjection, virtualCameraPos, 
-                          virtualCameraForward, recursionLevel + 1, stencilValue, currentTime, portal);
-    
-    // ========== 第6.5步：封住门户深度 ==========
-    // 关键修复：渲染完门户内容后，将门户表面的深度写入深度缓冲
-    // 这样后续渲染的其他门户（如Portal 2）就不会覆盖当前门户（Portal 1）
+    state.DepthRange(0.0, 1.0);
+    state.DepthFunc(GL_LESS);
+    state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    state.Enable(GL_CULL_FACE);
+    PopDebugGroup();  // Depth Clear
+    
+    // ========== 第3步：渲染门户另一侧的场景（渲染队列：不透明由近到远，天空盒最后）==========
+    // 模板测试保持为 GL_EQUAL stencilRef，确保只渲染到门户区域内
+    g_ViewUniforms.Bind(node.uniformOffset);
+    RenderViewQueue(index);
+    
+    if (conditional) {
+        glEndConditionalRender();
+    }
+}
+
+// 提交阶段：子视图全部绘制完成后封住门户深度并恢复父视图状态
+void SealPortalView(const PortalViewTree& tree, int index) {
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    const PortalViewNode& node = tree.nodes[index];
+    
+    // ========== 第4步：封住门户深度 ==========
+    // 渲染完门户内容后，将门户表面的深度写入深度缓冲
+    // 这样后续渲染的其他门户就不会覆盖当前门户
     // 门户表面作为一个"实体"存在于场景中，后面的内容会被它遮挡
+    // 同时把区域的模板值减一恢复为父视图的值，兄弟视图可以复用本视图的模板值
     PushDebugGroup("Seal Portal Depth");
     
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_EQUAL, stencilValue, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    glStencilMask(0x00);  // 不修改模板值
+    ApplyScissor(node.scissor);
+    state.Enable(GL_STENCIL_TEST);
+    state.StencilFunc(GL_EQUAL, node.stencilRef, PortalRenderer::STENCIL_DEPTH_MASK);
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_DECR);
+    state.StencilMask(PortalRenderer::STENCIL_DEPTH_MASK);
     
     // 只写入深度，不写入颜色
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_ALWAYS);  // 强制写入深度
-    glDisable(GL_CULL_FACE);
+    state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    state.DepthMask(GL_TRUE);
+    state.DepthFunc(GL_ALWAYS);  // 强制写入深度
+    state.Disable(GL_CULL_FACE);
     
-    // 使用当前视图矩阵（不是虚拟视图矩阵）绘制门户表面
-    // 这样深度值对应门户在主场景中的真实位置
-    glUseProgram(g_SceneShader);
-    glm::mat4 sealMVP = projectionMatrix * viewMatrix * portal->transform;
-    glUniformMatrix4fv(glGetUniformLocation(g_SceneShader, "uMVP"), 1, GL_FALSE, glm::value_ptr(sealMVP));
+    // 在父视图中绘制门户表面，深度值对应门户在父视图中的真实位置
+    // 父视图的 ViewBlock 保持绑定，后续兄弟视图的模板标记直接使用
+    state.UseProgram(g_SceneProgram.id);
+    g_ViewUniforms.Bind(tree.nodes[node.parent].uniformOffset);
+    glm::mat4 surfaceModel = node.portal->transform * g_PortalSurfaceMesh.dequantize;
+    glUniformMatrix4fv(g_SceneProgram[PortalGL::UNIFORM_MODEL], 1, GL_FALSE, glm::value_ptr(surfaceModel));
     
-    glBindVertexArray(g_PortalSurfaceVAO);
-    glDrawArrays(GL_TRIANGLES, 0, g_PortalSurfaceVertCount);
+    g_PortalSurfaceMesh.Draw();
     
     // 恢复状态
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glDepthFunc(GL_LESS);
-    glEnable(GL_CULL_FACE);
-    glStencilMask(0xFF);
+    state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    state.DepthFunc(GL_LESS);
+    state.Enable(GL_CULL_FACE);
+    state.StencilMask(0xFF);
     
     PopDebugGroup();  // Seal Portal Depth
     
-    // ========== 第7步：恢复模板状态 ==========
-    glStencilFunc(GL_EQUAL, recursionLevel == 0 ? 0 : stencilValue - 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    // ========== 第5步：恢复模板状态 ==========
+    state.StencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    state.Disable(GL_STENCIL_TEST);
     
-    glDisable(GL_STENCIL_TEST);
+    // 恢复父视图的裁剪矩形
+    ApplyScissor(tree.nodes[node.parent].scissor);
     
     PopDebugGroup(); // Portal content
 }
 
+// 提交阶段：按先序遍历扁平数组，离开一个子树时封口
+// 需已启用 GL_SCISSOR_TEST
+void SubmitPortalViewTree(const PortalViewTree& tree) {
+    int open[MAX_PORTAL_RECURSION + 1];
+    int openCount = 0;
+    
+    for (int i = 1; i < (int)tree.nodes.size(); i++) {
+        while (openCount > 0 && tree.nodes[open[openCount - 1]].subtreeEnd <= i) {
+            SealPortalView(tree, open[--openCount]);
+        }
+        SubmitPortalView(tree, i);
+        open[openCount++] = i;
+    }
+    while (openCount > 0) {
+        SealPortalView(tree, open[--openCount]);
+    }
+}
+
 // 渲染门户边框（排除特定门户对）
 // 用于递归渲染时，避免在门户内部看到正在穿越的门户对的边框
-void RenderPortalFramesExcluding(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, 
-                                  float time, PortalRenderer::Portal* excludePortal) {
-    glUseProgram(g_SceneShader);
+// 门户边框的世界空间包围盒（局部盒 ±(半宽+边框) × ±(半高+边框) × ±边框/2）
+void GetPortalFrameBounds(const PortalRenderer::Portal* portal, glm::vec3& outMin, glm::vec3& outMax) {
+    glm::vec3 extent(portal->width * 0.5f + PORTAL_FRAME_THICKNESS,
+                     portal->height * 0.5f + PORTAL_FRAME_THICKNESS,
+                     PORTAL_FRAME_THICKNESS * 0.5f);
+    glm::vec3 center = glm::vec3(portal->transform[3]);
+    // 变换后 AABB 的半尺寸 = |R| * extent
+    glm::vec3 half(0.0f);
+    for (int axis = 0; axis < 3; axis++) {
+        half += glm::abs(glm::vec3(portal->transform[axis])) * extent[axis];
+    }
+    outMin = center - half;
+    outMax = center + half;
+}
+
+// 每帧更新一次门框实例：模型矩阵、颜色和包围盒，并上传实例缓冲（大小随门户数量）
+void UpdatePortalFrameInstances() {
+    PortalFrameInstances& frames = g_PortalFrames;
+    size_t count = g_Portals.size();
+    frames.instances.resize(count);
+    frames.boundsMin.resize(count);
+    frames.boundsMax.resize(count);
+    
+    for (size_t i = 0; i < count; i++) {
+        const PortalRenderer::Portal* portal = g_Portals[i];
+        glm::vec3 color = i < frames.colors.size() ? frames.colors[i] : PORTAL_FRAME_COLOR_A;
+        frames.instances[i].model = portal->transform * g_PortalFrameMesh.dequantize;
+        frames.instances[i].color = glm::vec4(color, 1.0f);
+        GetPortalFrameBounds(portal, frames.boundsMin[i], frames.boundsMax[i]);
+    }
     
-    int renderedCount = 0;
-    for (size_t i = 0; i < g_Portals.size(); i++) {
-        PortalRenderer::Portal* portal = g_Portals[i];
-        
-        // 排除当前门户对（入口门户及其链接的出口门户）
-        if (excludePortal != nullptr) {
-            if (portal == excludePortal || portal == excludePortal->linkedPortal) {
-                if (g_DebugThisFrame) {
-                    glm::vec3 pos = glm::vec3(portal->transform[3]);
-                    std::cout << "  [FramesExcluding] Skipping portal at (" << pos.x << ", " << pos.y << ", " << pos.z << ")" << std::endl;
-                }
-                continue;
-            }
+    static_assert(sizeof(PortalFrameInstance) == PORTAL_FRAME_INSTANCE_TEXELS * sizeof(glm::vec4),
+                  "PortalFrameInstance must match the texel layout read by PORTAL_FRAME_VS");
+    glBindBuffer(GL_TEXTURE_BUFFER, frames.instanceBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, count * sizeof(PortalFrameInstance), frames.instances.data(), GL_STREAM_DRAW);
+}
+
+// 门框是否可见：门户所在扇区可达且门框与到达该扇区时的裁剪体相交（不属于扇区的门户用视图裁剪体）
+bool IsPortalFrameVisible(size_t frame, const PortalCulling::Frustum& frustum,
+                          const PortalSectors::CellVisit* visits, int visitCount) {
+    const PortalFrameInstances& frames = g_PortalFrames;
+    int cell = g_Portals[frame]->cell;
+    if (cell < 0) return PortalCulling::IntersectsAABB(frustum, frames.boundsMin[frame], frames.boundsMax[frame]);
+    for (int v = 0; v < visitCount; v++) {
+        if (visits[v].cell == cell &&
+            PortalCulling::IntersectsAABB(visits[v].frustum, frames.boundsMin[frame], frames.boundsMax[frame])) {
+            return true;
         }
-        
-        glm::mat4 mvp = projectionMatrix * viewMatrix * portal->transform;
-        glUniformMatrix4fv(glGetUniformLocation(g_SceneShader, "uMVP"), 1, GL_FALSE, glm::value_ptr(mvp));
-        
-        // 渲染门户边框
-        glBindVertexArray(g_PortalFrameVAO);
-        glDrawArrays(GL_TRIANGLES, 0, g_PortalFrameVertCount);
-        renderedCount++;
     }
-    
-    if (g_DebugThisFrame && excludePortal != nullptr) {
-        std::cout << "  [FramesExcluding] Rendered " << renderedCount << " portal frames" << std::endl;
+    return false;
+}
+
+// 收集本视图可见门框的实例下标，跳过被排除的门户对（只读门框实例，可在工作线程上执行）
+void ComputePortalFrameList(const PortalCulling::Frustum& frustum, const PortalSectors::CellVisit* visits,
+                            int visitCount, const PortalRenderer::Portal* excludePortal,
+                            std::vector<uint32_t>& indices) {
+    const PortalFrameInstances& frames = g_PortalFrames;
+    indices.clear();
+    
+    // 排除当前门户对（入口门户及其链接的出口门户）
+    size_t excluded = frames.instances.size();
+    size_t pair = excluded;
+    auto it = frames.indexOf.find(excludePortal);
+    if (it != frames.indexOf.end()) {
+        excluded = it->second;
+        pair = frames.pairIndex[excluded];
     }
-    
-    glBindVertexArray(0);
+    for (size_t i = 0; i < frames.instances.size(); i++) {
+        if (i == excluded || i == pair) continue;
+        if (IsPortalFrameVisible(i, frustum, visits, visitCount)) indices.push_back((uint32_t)i);
+    }
+}
+
+// 视图矩阵来自当前绑定的 ViewBlock，可见门框一次实例化绘制
+// first/count：本视图的可见门框下标在 g_PortalFrames.visibleIndices 中的范围
+void DrawPortalFrames(int first, GLsizei count) {
+    if (count == 0) return;
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    state.UseProgram(g_PortalFrameProgram.id);
+    glUniform1i(g_PortalFrameProgram[PortalGL::UNIFORM_FRAME_INDEX_OFFSET], first);
+    g_PortalFrameMesh.DrawInstanced(count);
 }
 
-// 渲染门户边框（在所有递归渲染完成后）
+// 渲染门户边框（在所有递归渲染完成后），可见门框已由主视图的绘制列表算好
 // 双面门户：不再渲染背面遮挡板，两面都可以看到对面场景
-void RenderPortalFrames(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float time) {
-    // 关键修复：门框应该只渲染在主场景区域（模板值为0）
-    // 不应该渲染在门户内部区域（模板值非0），否则会覆盖门户内容
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_EQUAL, 0, 0xFF);  // 只在模板值为0的区域渲染
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);  // 不修改模板值
-    glStencilMask(0x00);
-    
-    RenderPortalFramesExcluding(viewMatrix, projectionMatrix, time, nullptr);
-    
-    glDisable(GL_STENCIL_TEST);
-    glStencilMask(0xFF);
+// 门户区域封口时已写入门户平面深度（模板值也已恢复为0），门户后方的门框由深度测试挡住
+void RenderPortalFrames() {
+    const ViewDrawList& list = g_ViewDrawLists[0];
+    DrawPortalFrames(list.frameIndexOffset, (GLsizei)list.frameIndices.size());
 }
 
-void RenderFrame() {
+// currentTime: 动画/烘焙天空/传送冷却使用的时间（秒），由主循环传入
+void RenderFrame(float currentTime) {
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    state.BeginFrame();
+    g_GpuTimer.BeginFrame();
     PushDebugGroup("Frame");
     
+    // 清除受写掩码影响，确保颜色/深度/模板都可写（通常已是当前值，不会发出调用）
+    state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    state.DepthMask(GL_TRUE);
+    state.StencilMask(0xFF);
     glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
     
@@ -1247,50 +2362,131 @@ void RenderFrame() {
     front = glm::normalize(front);
     
     glm::mat4 viewMatrix = glm::lookAt(g_CameraPosition, g_CameraPosition + front, glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 projectionMatrix = glm::perspective(glm::radians(60.0f), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 1000.0f);
+    glm::mat4 projectionMatrix = glm::perspective(glm::radians(60.0f), (float)g_FramebufferWidth / (float)g_FramebufferHeight, 0.1f, 1000.0f);
     
-    float currentTime = (float)glfwGetTime();
+    // 主视图的世界空间视锥体，门户孔径视锥体从它开始逐层收窄
+    PortalCulling::Frustum viewFrustum = PortalCulling::ExtractFrustum(projectionMatrix * viewMatrix);
     
     // 设置调试标志 - 每2秒输出一次
     g_DebugThisFrame = (currentTime - g_LastDebugTime > 2.0f);
     if (g_DebugThisFrame) {
         g_LastDebugTime = currentTime;
-        std::cout << "\n=== Frame Debug @ " << currentTime << "s ===" << std::endl;
-        std::cout << "Camera: (" << g_CameraPosition.x << ", " << g_CameraPosition.y << ", " << g_CameraPosition.z << ")" << std::endl;
-        std::cout << "Looking: (" << front.x << ", " << front.y << ", " << front.z << ")" << std::endl;
+        PORTAL_LOG(Frame, Info, "=== Frame @ %.2fs === camera (%g, %g, %g) looking (%g, %g, %g)", currentTime,
+                   g_CameraPosition.x, g_CameraPosition.y, g_CameraPosition.z, front.x, front.y, front.z);
     }
     
-    // ============ 第1步：渲染主场景 ============
-    PushDebugGroup("1. Main Scene");
-    RenderScene(viewMatrix, projectionMatrix);
-    PopDebugGroup();
+    // ============ 遍历门户视图树并上传每视图 uniform ============
+    // 先在 CPU 上遍历出扁平的视图树（节点 0 为主视图），每个视图的 ViewBlock 只写入一次
+    PortalMath::ScreenRect fullScreen;
+    fullScreen.width = g_FramebufferWidth;
+    fullScreen.height = g_FramebufferHeight;
+    CollectOcclusionResults();
+    BuildPortalViewTree(g_PortalViewTree, PortalMath::RigidTransform::FromMatrix(viewMatrix), projectionMatrix,
+                        fullScreen, viewFrustum);
+    UploadViewUniforms(g_PortalViewTree, currentTime);
+    
+    // 门框实例每帧上传一次，所有视图共用；绘制列表的门框剔除读取其包围盒
+    UpdatePortalFrameInstances();
+    BuildSceneDrawLists(g_PortalViewTree);
+    
+    // 烘焙天空：本帧刷新若干个面（第一次或刚切换到烘焙模式时一次完成）
+    if (g_SkyMode == SkyMode::Baked) {
+        PushDebugGroup("0. Sky Bake");
+        UpdateSkyCubemap(currentTime, g_SkyCubemap.lastCycleStart < 0.0f);
+        PopDebugGroup();
+    }
     
-    // ============ 第2步：渲染天空盒（作为背景，在场景之后渲染）============
-    // 使用 GL_LEQUAL 深度测试，天空盒只渲染在没有场景几何体的地方
-    PushDebugGroup("2. Main Skybox");
-    RenderSkybox(viewMatrix, projectionMatrix, currentTime);
+    // ============ 第1-2步：渲染主场景和天空盒 ============
+    // 渲染队列：场景几何体由近到远，天空盒在最后用 GL_LEQUAL 只填充没有几何体的地方
+    PushDebugGroup("1-2. Main Scene + Skybox");
+    g_ViewUniforms.Bind(g_PortalViewTree.nodes[0].uniformOffset);
+    RenderViewQueue(0);
     PopDebugGroup();
     
-    // ============ 第3步：递归渲染门户内容 ============
-    // 使用模板缓冲实现真正的"透视"效果
-    PushDebugGroup("3. Portal Recursive Rendering");
-    RenderPortalsRecursive(viewMatrix, projectionMatrix, g_CameraPosition, front, 0, 0, currentTime);
+    // ============ 第3步：渲染门户内容 ============
+    // 用模板缓冲逐个视图实现"透视"效果
+    PushDebugGroup("3. Portal Views");
+    state.Enable(GL_SCISSOR_TEST);
+    SubmitPortalViewTree(g_PortalViewTree);
+    state.Disable(GL_SCISSOR_TEST);
     PopDebugGroup();
     
     // ============ 第4步：渲染门户边框 ============
+    // 每个视图封口后都会重新绑定父视图，这里已回到主视图的 ViewBlock
     PushDebugGroup("4. Portal Frames (Main View)");
-    RenderPortalFrames(viewMatrix, projectionMatrix, currentTime);
+    RenderPortalFrames();
     PopDebugGroup();
     
+    if (g_DebugThisFrame) {
+        PORTAL_LOG(Frame, Info, "Portal views: %zu, occlusion %s: queries=%d skipped=%d occluded=%d",
+                   g_PortalViewTree.nodes.size() - 1, GetOcclusionModeName(g_OcclusionMode),
+                   g_OcclusionStats.queriesIssued, g_OcclusionStats.viewsSkipped, g_OcclusionStats.viewsOccluded);
+        PORTAL_LOG(Frame, Info, "Scene draw commands: %zu across %zu views (one multi-draw each)",
+                   g_SceneDraws.commands.size(), g_SceneDraws.views.size());
+        const PortalViewNode& root = g_PortalViewTree.nodes[0];
+        PORTAL_LOG(Frame, Info, "Sectors: camera in '%s', main view reaches %d cell visits, %zu across all views",
+                   root.startCell >= 0 ? g_Sectors.cells[root.startCell].name.c_str() : "none",
+                   root.cellVisitCount, g_PortalViewTree.cellVisits.size());
+        PORTAL_LOG(Frame, Info, "Sky: %s, faces baked this frame=%d",
+                   g_SkyMode == SkyMode::Baked ? "Baked" : "Live", g_SkyCubemap.facesBaked);
+        PORTAL_LOG(Frame, Info, "GL state changes: issued=%d suppressed=%d", state.frame.issued, state.frame.suppressed);
+        PORTAL_LOG(Frame, Info, "Simulation: tick %llu at %.0f Hz, skipped=%llu, teleports=%u",
+                   (unsigned long long)g_WorldSnapshots.Front().tick, SIMULATION_TICK_RATE,
+                   (unsigned long long)g_SimulationThread.ticksSkipped.load(), g_WorldSnapshots.Front().teleports);
+        if (!g_GpuTimer.latest.scopes.empty()) {
+            PORTAL_LOG(Frame, Info, "GPU frame %llu: %.3f ms (P: per-zone percentiles, T: trace)",
+                       (unsigned long long)g_GpuTimer.latest.frameIndex, g_GpuTimer.latest.scopes[0].durationMs);
+        }
+    }
+    
     PopDebugGroup(); // Frame
+    g_GpuTimer.EndFrame();
+    
+    // Chrome trace 捕获完成后写文件
+    if (g_TracePath != nullptr && !g_GpuTimer.IsTracing()) {
+        if (PortalProfiler::WriteChromeTrace(g_TracePath, g_GpuTimer, PortalProfiler::GetCpuProfiler(), g_TraceStartNs)) {
+            PORTAL_LOG(General, Info, "CPU/GPU trace (%zu frames) written to %s", g_GpuTimer.trace.size(), g_TracePath);
+        } else {
+            PORTAL_LOG(General, Error, "Cannot write %s", g_TracePath);
+        }
+        g_TracePath = nullptr;
+    }
 }
 
 void Cleanup() {
     for (PortalRenderer::Portal* portal : g_Portals) {
-        PortalRenderer::DestroyPortal(portal);
         delete portal;
     }
     g_Portals.clear();
+    DestroyOcclusionQueries();
+    DestroySkyCubemap();
+    g_ViewUniforms.Destroy();
+    g_GpuTimer.Destroy();
+    g_JobPool.Stop();
+    if (g_SceneDraws.indirectBuffer) glDeleteBuffers(1, &g_SceneDraws.indirectBuffer);
+    PortalGeometry::DestroyStaticMesh(g_Scene.mesh);
+    PortalGeometry::DestroyStaticMesh(g_PortalFrameMesh);
+    if (g_PortalFrames.instanceTexture) glDeleteTextures(1, &g_PortalFrames.instanceTexture);
+    if (g_PortalFrames.indexTexture) glDeleteTextures(1, &g_PortalFrames.indexTexture);
+    if (g_PortalFrames.instanceBuffer) glDeleteBuffers(1, &g_PortalFrames.instanceBuffer);
+    if (g_PortalFrames.indexBuffer) glDeleteBuffers(1, &g_PortalFrames.indexBuffer);
+    g_PortalFrameProgram.Destroy();
+    PortalGeometry::DestroyStaticMesh(g_PortalSurfaceMesh);
+    PortalGeometry::DestroyStaticMesh(g_PortalBackMesh);
+    PortalGeometry::DestroyStaticMesh(g_ProceduralFloorMesh);
+    g_FloorProgram.Destroy();
+}
+
+// 按 T 捕获的 trace 帧数
+const int TRACE_FRAMES = 120;
+
+// 打印 CPU 区段、GPU 作用域的滚动百分位和本段时间的瓶颈判断
+void PrintProfileSummary() {
+    PortalLog::Flush();
+    PortalProfiler::CpuProfiler& cpu = PortalProfiler::GetCpuProfiler();
+    cpu.PrintSummary();
+    g_GpuTimer.PrintSummary();
+    PortalProfiler::PrintFrameBoundSummary(cpu, g_GpuTimer);
 }
 
 // Input handling
@@ -1302,29 +2498,278 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     float xoffset = (float)(xpos - lastX);
     float yoffset = (float)(lastY - ypos);
     lastX = xpos; lastY = ypos;
-    g_CameraYaw += xoffset * 0.1f;
-    g_CameraPitch += yoffset * 0.1f;
-    if (g_CameraPitch > 89.0f) g_CameraPitch = 89.0f;
-    if (g_CameraPitch < -89.0f) g_CameraPitch = -89.0f;
+    // 朝向由模拟线程推进，这里只累积增量
+    std::lock_guard<std::mutex> lock(g_InputMutex);
+    g_PendingInput.yawDelta += xoffset * MOUSE_SENSITIVITY;
+    g_PendingInput.pitchDelta += yoffset * MOUSE_SENSITIVITY;
 }
 
-void processInput(GLFWwindow* window, float deltaTime) {
-    float speed = 5.0f * deltaTime;
-    glm::vec3 front;
-    front.x = cos(glm::radians(g_CameraYaw));
-    front.y = 0.0f;
-    front.z = sin(glm::radians(g_CameraYaw));
-    front = glm::normalize(front);
-    glm::vec3 right = glm::normalize(glm::cross(front, glm::vec3(0, 1, 0)));
-    
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) g_CameraPosition += front * speed;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) g_CameraPosition -= front * speed;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) g_CameraPosition -= right * speed;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) g_CameraPosition += right * speed;
+void processInput(GLFWwindow* window) {
+    // 移动键只采样为位掩码，由模拟线程按固定步长积分
+    uint32_t moveKeys = 0;
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) moveKeys |= MOVE_FORWARD;
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) moveKeys |= MOVE_BACK;
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) moveKeys |= MOVE_LEFT;
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) moveKeys |= MOVE_RIGHT;
+    {
+        std::lock_guard<std::mutex> lock(g_InputMutex);
+        g_PendingInput.moveKeys = moveKeys;
+    }
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) glfwSetWindowShouldClose(window, true);
+    
+    // O：循环切换门户遮挡查询模式（按下沿触发）
+    static bool occlusionKeyDown = false;
+    bool occlusionKey = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (occlusionKey && !occlusionKeyDown) {
+        SetOcclusionMode((PortalOcclusionMode)(((int)g_OcclusionMode + 1) % 3));
+    }
+    occlusionKeyDown = occlusionKey;
+    
+    // F：切换网格/程序化地板
+    static bool floorKeyDown = false;
+    bool floorKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (floorKey && !floorKeyDown) {
+        SetFloorMode(g_FloorMode == FloorMode::Procedural ? FloorMode::Tiled : FloorMode::Procedural);
+    }
+    floorKeyDown = floorKey;
+    
+    // K：切换实时/烘焙天空
+    static bool skyKeyDown = false;
+    bool skyKey = glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS;
+    if (skyKey && !skyKeyDown) {
+        SetSkyMode(g_SkyMode == SkyMode::Baked ? SkyMode::Live : SkyMode::Baked);
+    }
+    skyKeyDown = skyKey;
+    
+    // P：打印各 CPU 区段和 GPU 作用域的滚动百分位
+    static bool summaryKeyDown = false;
+    bool summaryKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (summaryKey && !summaryKeyDown) {
+        PrintProfileSummary();
+    }
+    summaryKeyDown = summaryKey;
+    
+    // T：捕获接下来 TRACE_FRAMES 帧的 CPU 区段和 GPU 计时，写成 Chrome trace
+    static bool traceKeyDown = false;
+    bool traceKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (traceKey && !traceKeyDown && g_TracePath == nullptr) {
+        g_GpuTimer.StartTrace(TRACE_FRAMES);
+        g_TraceStartNs = PortalProfiler::CpuNowNs();
+        g_TracePath = "portal_trace.json";
+        PORTAL_LOG(General, Info, "Capturing CPU/GPU trace for %d frames...", TRACE_FRAMES);
+    }
+    traceKeyDown = traceKey;
 }
 
-int main() {
+// 创建着色器、几何体、门户和初始 GL 状态（需要当前 GL 上下文，窗口/无头模式共用）
+void InitRendering() {
+    // Create scene shader
+    g_SceneProgram.Build("scene", SCENE_VS, SCENE_FS);
+    g_ViewUniforms.Create(64);
+    g_GpuTimer.Create();
+    g_JobPool.Start(PortalJobs::DefaultWorkerCount());
+    
+    CreateSceneGeometry();
+    CreatePortalVisuals();
+    CreatePortalSurfaceShader();
+    CreateProceduralFloor();
+    CreateSkybox();
+    CreateSkyCubemap();
+    SetupPortals();
+    SetupSectors();
+    SetupPlayer();
+    
+    // 固定管线状态经由状态缓存设置，渲染路径不再直接调用 glEnable/glDepthMask 等
+    // 初始化阶段有直接调用 GL 绑定 VAO 的代码，先让影子值作废
+    PortalGL::StateCache& state = PortalGL::GetStateCache();
+    state.Invalidate();
+    state.Enable(GL_DEPTH_TEST);
+    state.Enable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+}
+
+#ifdef PORTAL_HEADLESS
+// ============================================================================
+// 无头模式：EGL 无表面上下文 + 离屏 FBO，相机沿脚本路径运行固定帧数，
+// 输出逐帧 CPU/GPU 耗时，可选保存 PNG
+// ============================================================================
+
+// 基准相机路径：远景 → 贴近门户A（深层递归）→ 看向门户B → 俯瞰
+// 各段都不穿过门户四边形，结果不受传送影响
+PortalHeadless::CameraPath MakeBenchmarkCameraPath() {
+    PortalHeadless::CameraPath path;
+    path.keys = {
+        { glm::vec3( 0.0f, 1.7f,   5.0f),  -90.0f,   0.0f },
+        { glm::vec3(-5.0f, 1.7f,   4.0f),  -90.0f,   0.0f },
+        { glm::vec3(-5.0f, 1.7f,   0.8f),  -90.0f,   0.0f },
+        { glm::vec3(-2.0f, 1.7f,   3.0f),  -60.0f,   0.0f },
+        { glm::vec3( 1.0f, 1.7f, -10.0f),    0.0f,   0.0f },
+        { glm::vec3( 0.0f, 4.0f,   8.0f), -110.0f, -15.0f },
+    };
+    return path;
+}
+
+// 逐帧记录（GPU 耗时在全部帧结束后读回，运行中不等待查询结果）
+struct HeadlessFrameRecord {
+    float time = 0.0f;
+    double cpuMs = 0.0;
+    double gpuMs = 0.0;
+    size_t portalViews = 0;
+    size_t sceneCommands = 0;
+    uint32_t stateIssued = 0;
+    uint32_t stateSuppressed = 0;
+};
+
+int RunHeadless(const PortalHeadless::Options& options) {
+    PortalHeadless::Context context;
+    if (!PortalHeadless::CreateContext(context)) return -1;
+    
+    // GLX 构建的 GLEW 在 EGL 上下文中找不到 GLX 显示，但 GL 入口已经全部加载
+    glewExperimental = GL_TRUE;
+    GLenum glewStatus = glewInit();
+    if (glewStatus != GLEW_OK && glewStatus != GLEW_ERROR_NO_GLX_DISPLAY) {
+        std::cerr << "GLEW init failed!" << std::endl;
+        PortalHeadless::DestroyContext(context);
+        return -1;
+    }
+    
+    PortalHeadless::Backbuffer backbuffer;
+    if (!backbuffer.Create(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        PortalHeadless::DestroyContext(context);
+        return -1;
+    }
+    g_BackbufferFBO = backbuffer.fbo;
+    InitRendering();
+    glBindFramebuffer(GL_FRAMEBUFFER, g_BackbufferFBO);
+    g_FramebufferWidth = WINDOW_WIDTH;
+    g_FramebufferHeight = WINDOW_HEIGHT;
+    glViewport(0, 0, g_FramebufferWidth, g_FramebufferHeight);
+    
+    if (!options.tracePath.empty()) {
+        g_GpuTimer.StartTrace(options.frames);
+        g_TraceStartNs = PortalProfiler::CpuNowNs();
+    }
+    
+    PortalHeadless::CameraPath path = MakeBenchmarkCameraPath();
+    std::vector<HeadlessFrameRecord> records(options.frames);
+    std::vector<GLuint> timerQueries(options.frames);
+    glGenQueries(options.frames, timerQueries.data());
+    std::vector<uint8_t> pixels;
+    
+    PORTAL_LOG(General, Info, "Headless: %d frames at %dx%d, step %gs", options.frames, WINDOW_WIDTH, WINDOW_HEIGHT,
+               options.frameStep);
+    
+    for (int frame = 0; frame < options.frames; frame++) {
+        HeadlessFrameRecord& record = records[frame];
+        record.time = frame * options.frameStep;
+        
+        // 无头模式不启动模拟线程：脚本相机直接作为模拟状态，在本线程上做传送检测
+        PortalHeadless::CameraKey camera = path.Sample(record.time);
+        g_SimCamera.position = camera.position;
+        g_SimCamera.yaw = camera.yaw;
+        g_SimCamera.pitch = camera.pitch;
+        UpdatePlayer(g_SimCamera, record.time);
+        g_CameraPosition = g_SimCamera.position;
+        g_CameraYaw = g_SimCamera.yaw;
+        g_CameraPitch = g_SimCamera.pitch;
+        
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[frame]);
+        auto start = std::chrono::steady_clock::now();
+        RenderFrame(record.time);
+        record.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glEndQuery(GL_TIME_ELAPSED);
+        // 代替 SwapBuffers：把本帧命令提交给驱动
+        glFlush();
+        PortalProfiler::GetCpuProfiler().EndFrame();
+        
+        PortalGL::StateCache& state = PortalGL::GetStateCache();
+        record.portalViews = g_PortalViewTree.nodes.size() - 1;
+        record.sceneCommands = g_SceneDraws.commands.size();
+        record.stateIssued = state.frame.issued;
+        record.stateSuppressed = state.frame.suppressed;
+        
+        if (options.captureEvery > 0 && frame % options.captureEvery == 0) {
+            char name[64];
+            snprintf(name, sizeof(name), "/frame_%05d.png", frame);
+            backbuffer.ReadPixels(pixels);
+            PortalHeadless::WritePNG(options.captureDir + name, backbuffer.width, backbuffer.height, pixels, true);
+        }
+    }
+    
+    // 等待 GPU 完成，读取计时器中尚未读取的帧
+    g_GpuTimer.Flush();
+    
+    std::vector<double> cpuSamples, gpuSamples;
+    for (int frame = 0; frame < options.frames; frame++) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(timerQueries[frame], GL_QUERY_RESULT, &elapsed);
+        records[frame].gpuMs = (double)elapsed / 1.0e6;
+        cpuSamples.push_back(records[frame].cpuMs);
+        gpuSamples.push_back(records[frame].gpuMs);
+    }
+    glDeleteQueries(options.frames, timerQueries.data());
+    
+    PortalLog::Flush();
+    printf("[Headless] %d frames\n", options.frames);
+    PortalHeadless::PrintTimingSummary("CPU", cpuSamples);
+    PortalHeadless::PrintTimingSummary("GPU", gpuSamples);
+    PrintProfileSummary();
+    if (!options.tracePath.empty()) {
+        if (PortalProfiler::WriteChromeTrace(options.tracePath.c_str(), g_GpuTimer, PortalProfiler::GetCpuProfiler(),
+                                             g_TraceStartNs)) {
+            std::cout << "CPU/GPU trace (" << g_GpuTimer.trace.size() << " frames) written to " << options.tracePath << std::endl;
+        } else {
+            std::cerr << "Cannot write " << options.tracePath << std::endl;
+        }
+    }
+    
+    if (!options.csvPath.empty()) {
+        FILE* csv = fopen(options.csvPath.c_str(), "w");
+        if (csv) {
+            fprintf(csv, "frame,time_s,cpu_ms,gpu_ms,portal_views,scene_commands,state_issued,state_suppressed\n");
+            for (int frame = 0; frame < options.frames; frame++) {
+                const HeadlessFrameRecord& r = records[frame];
+                fprintf(csv, "%d,%.4f,%.4f,%.4f,%zu,%zu,%u,%u\n", frame, r.time, r.cpuMs, r.gpuMs,
+                        r.portalViews, r.sceneCommands, r.stateIssued, r.stateSuppressed);
+            }
+            fclose(csv);
+            std::cout << "Per-frame timings written to " << options.csvPath << std::endl;
+        } else {
+            std::cerr << "Cannot write " << options.csvPath << std::endl;
+        }
+    }
+    
+    Cleanup();
+    backbuffer.Destroy();
+    PortalHeadless::DestroyContext(context);
+    return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+    // 日志：--log 级别配置（如 portal=debug,frame=warn），--log-file 输出到文件（默认 stdout）
+    const char* logFile = nullptr;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--log") == 0 && !PortalLog::ParseLevels(argv[i + 1])) {
+            std::cerr << "Invalid --log spec: " << argv[i + 1] << std::endl;
+            return -1;
+        }
+        if (strcmp(argv[i], "--log-file") == 0) logFile = argv[i + 1];
+    }
+    if (!PortalLog::Start(logFile)) {
+        std::cerr << "Cannot open " << logFile << ", logging to stdout" << std::endl;
+    }
+    
+#ifdef PORTAL_HEADLESS
+    if (PortalHeadless::HasFlag(argc, argv, "--headless")) {
+        PortalHeadless::Options options;
+        if (!PortalHeadless::ParseOptions(argc, argv, options)) return -1;
+        int result = RunHeadless(options);
+        PortalLog::Shutdown();
+        return result;
+    }
+#endif
+    
     if (!glfwInit()) { std::cerr << "GLFW init failed!" << std::endl; return -1; }
     
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -1342,48 +2787,31 @@ int main() {
     glewExperimental = GL_TRUE;
     if (glewInit() != GLEW_OK) { std::cerr << "GLEW init failed!" << std::endl; return -1; }
     
-    // Create scene shader
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &SCENE_VS, nullptr);
-    glCompileShader(vs);
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &SCENE_FS, nullptr);
-    glCompileShader(fs);
-    g_SceneShader = glCreateProgram();
-    glAttachShader(g_SceneShader, vs);
-    glAttachShader(g_SceneShader, fs);
-    glLinkProgram(g_SceneShader);
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    
-    CreateSceneGeometry();
-    CreatePortalVisuals();
-    CreatePortalSurfaceShader();
-    CreateSkybox();
-    SetupPortals();
-    SetupPlayer();
-    
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    
-    float lastTime = (float)glfwGetTime();
+    InitRendering();
+    g_SimulationThread.Start(SIMULATION_TICK_RATE, SimulationTick);
     
-    std::cout << "Controls: WASD to move, Mouse to look, ESC to exit" << std::endl;
+    std::cout << "Controls: WASD to move, Mouse to look, O to cycle portal occlusion mode, F to toggle floor mode, K to toggle sky mode, "
+                 "P to print CPU/GPU zone percentiles, T to capture a CPU/GPU trace, ESC to exit" << std::endl;
     
     while (!glfwWindowShouldClose(window)) {
         float currentTime = (float)glfwGetTime();
-        float deltaTime = currentTime - lastTime;
-        lastTime = currentTime;
         
         glfwPollEvents();
-        processInput(window, deltaTime);
-        UpdatePlayer(deltaTime, currentTime);
-        RenderFrame();
+        processInput(window);
+        ApplyWorldSnapshot();
+        // glScissor/glViewport 使用帧缓冲像素，HiDPI 下与窗口尺寸不同；最小化时尺寸为 0，跳过渲染
+        glfwGetFramebufferSize(window, &g_FramebufferWidth, &g_FramebufferHeight);
+        if (g_FramebufferWidth > 0 && g_FramebufferHeight > 0) {
+            glViewport(0, 0, g_FramebufferWidth, g_FramebufferHeight);
+            RenderFrame(currentTime);
+        }
         glfwSwapBuffers(window);
+        PortalProfiler::GetCpuProfiler().EndFrame();
     }
     
+    g_SimulationThread.Stop();
     Cleanup();
+    PortalLog::Shutdown();
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;